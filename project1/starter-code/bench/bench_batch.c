@@ -0,0 +1,81 @@
+/**
+ * Commands per second of the shell reading a generated command file in
+ * batch mode (block reads, no termios) against the interactive path
+ * (getchar, tcsetattr twice per command, prompt), forced with -i.
+ * Usage: bench_batch [path to mishell] [commands]
+ */
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+static double now_s(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double run_shell(const char *shell, const char *script, bool interactive) {
+	double start = now_s();
+	pid_t pid = fork();
+	if (pid == 0) {
+		int in = open(script, O_RDONLY);
+		int out = open("/dev/null", O_WRONLY);
+		dup2(in, STDIN_FILENO);
+		dup2(out, STDOUT_FILENO);
+		if (interactive)
+			execl(shell, shell, "-i", (char *)NULL);
+		else
+			execl(shell, shell, (char *)NULL);
+		_exit(127);
+	}
+	waitpid(pid, NULL, 0);
+	return now_s() - start;
+}
+
+static void write_script(const char *path, const char *line, int count) {
+	FILE *f = fopen(path, "w");
+	for (int i = 0; i < count; i++)
+		fprintf(f, "%s\n", line);
+	fprintf(f, "exit\n");
+	fclose(f);
+}
+
+int main(int argc, char **argv) {
+	const char *shell = argc > 1 ? argv[1] : "./mishell";
+	int count = argc > 2 ? atoi(argv[2]) : 20000;
+	char script[] = "/tmp/bench_batch_XXXXXX";
+	int fd = mkstemp(script);
+	if (fd == -1) {
+		perror("mkstemp");
+		return 1;
+	}
+	close(fd);
+
+	static const struct {
+		const char *label;
+		const char *line;
+		int divisor; // external commands are much slower
+	} workloads[] = {
+		{"builtin (cd .)", "cd .", 1},
+		{"builtin, 32 args", "cd . a b c d e f g h i j k l m n o p q r s t u v w x y z 1 2 3 4 5", 1},
+		{"external (true)", "true", 20},
+	};
+
+	printf("%-20s %10s %16s %16s %8s\n", "workload", "commands", "interactive/s", "batch/s", "ratio");
+	for (size_t i = 0; i < sizeof(workloads) / sizeof(workloads[0]); i++) {
+		int n = count / workloads[i].divisor;
+		write_script(script, workloads[i].line, n);
+		double t_int = run_shell(shell, script, true);
+		double t_batch = run_shell(shell, script, false);
+		printf("%-20s %10d %16.0f %16.0f %7.1fx\n", workloads[i].label, n,
+			   n / t_int, n / t_batch, t_int / t_batch);
+	}
+
+	unlink(script);
+	return 0;
+}
@@ -0,0 +1,142 @@
+/**
+ * hdiff --delta: patch size and encode throughput. The new file is the old
+ * one with a few inserts, deletes and overwrites, which shifts most of it
+ * against the old offsets; the fixed-offset compare of hdiff -b is shown
+ * for contrast. An unrelated new file measures the worst case, in which the
+ * checksum rolls over every byte without finding a match.
+ * Usage: bench_delta [megabytes] [edits]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hdiff.h"
+
+static double now_s(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void write_file(const char *path, const unsigned char *data, size_t size) {
+	FILE *f = fopen(path, "w");
+	fwrite(data, 1, size, f);
+	fclose(f);
+}
+
+static size_t file_size(const char *path) {
+	struct stat st;
+	return stat(path, &st) == 0 ? (size_t)st.st_size : 0;
+}
+
+static bool same_file(const char *path, const unsigned char *data, size_t size) {
+	FILE *f = fopen(path, "r");
+	unsigned char *buf = malloc(size + 1);
+	size_t n = fread(buf, 1, size + 1, f);
+	bool same = n == size && memcmp(buf, data, size) == 0;
+	fclose(f);
+	free(buf);
+	return same;
+}
+
+/**
+ * Encode old -> new a few times, check that the patch applies, and print
+ * the best run
+ */
+static void run(const char *name, const char *old_path, const char *new_path,
+		const unsigned char *new_data, size_t new_size, const char *patch_path) {
+	double best = 1e9;
+	for (int i = 0; i < 3; i++) {
+		FILE *patch = fopen(patch_path, "w");
+		double start = now_s();
+		hdiff_delta(old_path, new_path, patch);
+		fclose(patch);
+		double t = now_s() - start;
+		if (t < best)
+			best = t;
+	}
+
+	char out_path[] = "/tmp/bench_delta_XXXXXX";
+	int fd = mkstemp(out_path);
+	close(fd);
+	FILE *out = fopen(out_path, "w");
+	double start = now_s();
+	hdiff_apply(old_path, patch_path, out);
+	fclose(out);
+	double t_apply = now_s() - start;
+	bool ok = same_file(out_path, new_data, new_size);
+	unlink(out_path);
+
+	size_t patch_size = file_size(patch_path);
+	printf("%-10s %12zu %9.3f%% %10.2f %10.2f %6s\n", name, patch_size,
+	       100.0 * patch_size / new_size, new_size / best / 1e9, new_size / t_apply / 1e9,
+	       ok ? "ok" : "WRONG");
+}
+
+int main(int argc, char **argv) {
+	size_t mb = argc > 1 ? strtoul(argv[1], NULL, 10) : 64;
+	size_t edits = argc > 2 ? strtoul(argv[2], NULL, 10) : 100;
+	size_t size = mb << 20;
+	char old_path[] = "/tmp/bench_delta_XXXXXX", new_path[] = "/tmp/bench_delta_XXXXXX";
+	char patch_path[] = "/tmp/bench_delta_XXXXXX";
+	int fds[3] = {mkstemp(old_path), mkstemp(new_path), mkstemp(patch_path)};
+	for (int i = 0; i < 3; i++) {
+		if (fds[i] == -1) {
+			perror("mkstemp");
+			return 1;
+		}
+		close(fds[i]);
+	}
+
+	unsigned char *old = malloc(size), *new = malloc(size + edits * 64);
+	srand(1);
+	for (size_t i = 0; i < size; i++)
+		old[i] = rand();
+	write_file(old_path, old, size);
+
+	// walk the old file, copying runs and inserting, skipping or
+	// overwriting up to 64 bytes between them
+	size_t new_size = 0, gap = size / (edits + 1);
+	for (size_t pos = 0; pos < size;) {
+		size_t run_len = gap < size - pos ? gap : size - pos;
+		memcpy(new + new_size, old + pos, run_len);
+		new_size += run_len;
+		pos += run_len;
+		size_t len = 1 + rand() % 64;
+		switch (rand() % 3) {
+		case 0: // insert
+			for (size_t i = 0; i < len; i++)
+				new[new_size++] = rand();
+			break;
+		case 1: // delete
+			pos += len < size - pos ? len : size - pos;
+			break;
+		default: // overwrite
+			for (size_t i = 0; i < len && pos < size; i++, pos++)
+				new[new_size++] = rand();
+		}
+	}
+	write_file(new_path, new, new_size);
+
+	printf("%zu MB, %zu edits\n", mb, edits);
+	printf("fixed-offset compare: %llu of %zu bytes differ\n",
+	       (unsigned long long)hdiff_count(old, new, new_size < size ? new_size : size), new_size);
+	printf("%-10s %12s %10s %10s %10s %6s\n", "input", "patch bytes", "of new", "enc GB/s",
+	       "apply GB/s", "check");
+	run("edited", old_path, new_path, new, new_size, patch_path);
+
+	for (size_t i = 0; i < size; i++)
+		new[i] = rand();
+	write_file(new_path, new, size);
+	run("unrelated", old_path, new_path, new, size, patch_path);
+
+	free(old);
+	free(new);
+	unlink(old_path);
+	unlink(new_path);
+	unlink(patch_path);
+	return 0;
+}
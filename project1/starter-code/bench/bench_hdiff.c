@@ -0,0 +1,90 @@
+/**
+ * hdiff -b throughput: the old loop with one fread per byte and file against
+ * the mapped, vectorized compare, on two files that differ in a few places.
+ * Usage: bench_hdiff [megabytes] [differing bytes]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hdiff.h"
+
+static double now_s(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// the comparison hdiff -b used before, printing dropped
+static int legacy_compare(const char *path1, const char *path2) {
+	FILE *file1 = fopen(path1, "r");
+	FILE *file2 = fopen(path2, "r");
+	char byte1, byte2;
+	int diff_bytes = 0;
+
+	while (fread(&byte1, sizeof(char), 1, file1) && fread(&byte2, sizeof(char), 1, file2)) {
+		if (byte1 != byte2)
+			diff_bytes++;
+	}
+	fclose(file1);
+	fclose(file2);
+	return diff_bytes;
+}
+
+static void write_inputs(const char *path1, const char *path2, size_t bytes, size_t diffs) {
+	unsigned char *buf = malloc(bytes);
+	srand(1);
+	for (size_t i = 0; i < bytes; i++)
+		buf[i] = rand();
+
+	FILE *f = fopen(path1, "w");
+	fwrite(buf, 1, bytes, f);
+	fclose(f);
+	for (size_t i = 0; i < diffs; i++)
+		buf[(size_t)rand() * RAND_MAX % bytes] ^= 0xff;
+	f = fopen(path2, "w");
+	fwrite(buf, 1, bytes, f);
+	fclose(f);
+	free(buf);
+}
+
+int main(int argc, char **argv) {
+	size_t mb = argc > 1 ? strtoul(argv[1], NULL, 10) : 64;
+	size_t diffs = argc > 2 ? strtoul(argv[2], NULL, 10) : 1000;
+	char path1[] = "/tmp/bench_hdiff_XXXXXX", path2[] = "/tmp/bench_hdiff_XXXXXX";
+	int fd1 = mkstemp(path1), fd2 = mkstemp(path2);
+	if (fd1 == -1 || fd2 == -1) {
+		perror("mkstemp");
+		return 1;
+	}
+	close(fd1);
+	close(fd2);
+	write_inputs(path1, path2, mb << 20, diffs);
+
+	FILE *null = fopen("/dev/null", "w");
+	double start = now_s();
+	int legacy_diff = legacy_compare(path1, path2);
+	double t_legacy = now_s() - start;
+
+	double t_new = 1e9;
+	for (int run = 0; run < 5; run++) {
+		start = now_s();
+		hdiff_binary(path1, path2, null);
+		double t = now_s() - start;
+		if (t < t_new)
+			t_new = t;
+	}
+
+	printf("%zu MB, %d differing bytes\n", mb, legacy_diff);
+	printf("%-22s %10s %10s\n", "method", "seconds", "GB/s");
+	printf("%-22s %10.3f %10.2f\n", "fread per byte", t_legacy, (mb << 20) / t_legacy / 1e9);
+	printf("%-22s %10.3f %10.2f\n", "mmap + vector compare", t_new, (mb << 20) / t_new / 1e9);
+	printf("speedup %.0fx\n", t_legacy / t_new);
+
+	fclose(null);
+	unlink(path1);
+	unlink(path2);
+	return 0;
+}
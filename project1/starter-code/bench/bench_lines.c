@@ -0,0 +1,122 @@
+/**
+ * Line splitting throughput in GB/s: the old fgets(512) loop of uniq, a
+ * memchr split over the mapping, and the line_source views (mmap plus the
+ * vectorized newline scan). The file is read once first so every pass runs
+ * from the page cache.
+ * Usage: bench_lines [megabytes] [average line length]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "lines.h"
+
+static double now_s(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void write_input(const char *path, size_t bytes, int avg_len) {
+	FILE *f = fopen(path, "w");
+	char line[4096];
+	size_t written = 0;
+
+	srand(1);
+	while (written < bytes) {
+		int len = avg_len / 2 + rand() % (avg_len + 1);
+		if (len > (int)sizeof(line) - 1)
+			len = sizeof(line) - 1;
+		for (int i = 0; i < len; i++)
+			line[i] = 'a' + rand() % 26;
+		line[len] = '\n';
+		fwrite(line, 1, len + 1, f);
+		written += len + 1;
+	}
+	fclose(f);
+}
+
+static size_t split_fgets(const char *path) {
+	FILE *f = fopen(path, "r");
+	char line[512];
+	size_t n = 0;
+	while (fgets(line, sizeof(line), f)) {
+		size_t len = strlen(line);
+		if (len && line[len - 1] == '\n')
+			line[len - 1] = 0;
+		n++;
+	}
+	fclose(f);
+	return n;
+}
+
+static size_t split_memchr(const char *path) {
+	struct line_source src;
+	size_t n = 0;
+
+	// only to borrow the mapping
+	lines_open(&src, path);
+	const char *p = src.data, *end = src.data + src.size;
+	while (p < end) {
+		const char *nl = memchr(p, '\n', end - p);
+		n++;
+		p = nl ? nl + 1 : end;
+	}
+	lines_close(&src);
+	return n;
+}
+
+static size_t split_lines(const char *path) {
+	struct line_source src;
+	size_t n = 0, len;
+
+	lines_open(&src, path);
+	while (lines_next(&src, &len))
+		n++;
+	lines_close(&src);
+	return n;
+}
+
+int main(int argc, char **argv) {
+	size_t mb = argc > 1 ? strtoul(argv[1], NULL, 10) : 256;
+	int avg_len = argc > 2 ? atoi(argv[2]) : 80;
+	char path[] = "/tmp/bench_lines_XXXXXX";
+	int fd = mkstemp(path);
+	if (fd == -1) {
+		perror("mkstemp");
+		return 1;
+	}
+	close(fd);
+	write_input(path, mb << 20, avg_len);
+	split_lines(path);
+
+	static const struct {
+		const char *label;
+		size_t (*split)(const char *);
+	} methods[] = {
+		{"fgets(512)", split_fgets},
+		{"mmap + memchr", split_memchr},
+		{"line_source", split_lines},
+	};
+
+	printf("%zu MB, average line %d bytes\n", mb, avg_len);
+	printf("%-16s %12s %10s\n", "method", "lines", "GB/s");
+	for (size_t i = 0; i < sizeof(methods) / sizeof(methods[0]); i++) {
+		double best = 1e9;
+		size_t lines = 0;
+		for (int run = 0; run < 3; run++) {
+			double start = now_s();
+			lines = methods[i].split(path);
+			double t = now_s() - start;
+			if (t < best)
+				best = t;
+		}
+		printf("%-16s %12zu %10.2f\n", methods[i].label, lines, (mb << 20) / best / 1e9);
+	}
+
+	unlink(path);
+	return 0;
+}
@@ -0,0 +1,288 @@
+/**
+ * Parse cost of the arena-backed parse_command against the old parser,
+ * which malloc'd every name, argument and redirect and freed them again
+ * recursively. The old parser is kept below, unchanged except for names,
+ * with its allocator calls counted. The arena column is the number of
+ * chunks malloc'd over all iterations, since the arena is reused.
+ * Usage: bench_parse [iterations]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "shelly.h"
+
+static unsigned long allocator_calls;
+
+static void *counted_malloc(size_t size) {
+	allocator_calls++;
+	return malloc(size);
+}
+
+static void *counted_realloc(void *p, size_t size) {
+	allocator_calls++;
+	return realloc(p, size);
+}
+
+static char *counted_strdup(const char *s) {
+	allocator_calls++;
+	return strdup(s);
+}
+
+static void counted_free(void *p) {
+	allocator_calls++;
+	free(p);
+}
+
+#define malloc counted_malloc
+#define realloc counted_realloc
+#define strdup counted_strdup
+#define free counted_free
+
+static int legacy_free_command(struct command_t *command) {
+	if (command->arg_count) {
+		for (int i = 0; i < command->arg_count; ++i)
+			free(command->args[i]);
+		free(command->args);
+	}
+
+	for (int i = 0; i < 3; ++i) {
+		if (command->redirects[i])
+			free(command->redirects[i]);
+	}
+
+	if (command->next) {
+		legacy_free_command(command->next);
+		command->next = NULL;
+	}
+
+	free(command->name);
+	free(command);
+	return 0;
+}
+static int legacy_parse_command(char *buf, struct command_t *command) {
+	const char *splitters = " \t"; // split at whitespace
+	int index, len;
+	len = strlen(buf);
+
+	// trim left whitespace
+	while (len > 0 && strchr(splitters, buf[0]) != NULL) {
+		buf++;
+		len--;
+	}
+
+	while (len > 0 && strchr(splitters, buf[len - 1]) != NULL) {
+		// trim right whitespace
+		buf[--len] = 0;
+	}
+
+	// auto-complete
+	if (len > 0 && buf[len - 1] == '?') {
+		command->auto_complete = true;
+	}
+
+	// background
+	if (len > 0 && buf[len - 1] == '&') {
+		command->background = true;
+	}
+
+	char *pch = strtok(buf, splitters);
+
+
+	if (pch == NULL) {
+		command->name = (char *)malloc(1);
+		command->name[0] = 0;
+	} else {
+		command->name = (char *)malloc(strlen(pch) + 1);
+		strcpy(command->name, pch);
+	}
+
+	command->args = (char **)malloc(sizeof(char *));
+
+	int redirect_index;
+	int arg_index = 0;
+	char temp_buf[1024], *arg;
+
+	while (1) {
+		// tokenize input on splitters
+		pch = strtok(NULL, splitters);
+		if (!pch)
+			break;
+		arg = temp_buf;
+		strcpy(arg, pch);
+		len = strlen(arg);
+
+		// empty arg, go for next
+		if (len == 0) {
+			continue;
+		}
+
+		// trim left whitespace
+		while (len > 0 && strchr(splitters, arg[0]) != NULL) {
+			arg++;
+			len--;
+		}
+
+		// trim right whitespace
+		while (len > 0 && strchr(splitters, arg[len - 1]) != NULL) {
+			arg[--len] = 0;
+		}
+
+		// empty arg, go for next
+		if (len == 0) {
+			continue;
+		}
+
+		// piping to another command
+		if (strcmp(arg, "|") == 0) {
+			struct command_t *c = calloc(1, sizeof(struct command_t));
+			int l = strlen(pch);
+			pch[l] = splitters[0]; // restore strtok termination
+			index = 1;
+			while (pch[index] == ' ' || pch[index] == '\t')
+				index++; // skip whitespaces
+
+			legacy_parse_command(pch + index, c);
+			pch[l] = 0; // put back strtok termination
+			command->next = c;
+			continue;
+		}
+
+		// background process
+		if (strcmp(arg, "&") == 0) {
+			// handled before
+			continue;
+		}
+
+		// handle input redirection
+		redirect_index = -1;
+		if (arg[0] == '<') {
+			redirect_index = 0;
+		}
+
+		if (arg[0] == '>') {
+			if (len > 1 && arg[1] == '>') {
+				redirect_index = 2;
+				arg++;
+				len--;
+			} else {
+				redirect_index = 1;
+			}
+		}
+
+		if (redirect_index != -1) {
+			command->redirects[redirect_index] = malloc(len);
+			strcpy(command->redirects[redirect_index], arg + 1);
+			continue;
+		}
+
+		// normal arguments
+		if (len > 2 &&
+			((arg[0] == '"' && arg[len - 1] == '"') ||
+			 (arg[0] == '\'' && arg[len - 1] == '\''))) // quote wrapped arg
+		{
+			arg[--len] = 0;
+			arg++;
+		}
+
+		command->args =
+			(char **)realloc(command->args, sizeof(char *) * (arg_index + 1));
+
+		command->args[arg_index] = (char *)malloc(len + 1);
+		strcpy(command->args[arg_index++], arg);
+	}
+	command->arg_count = arg_index;
+
+	// increase args size by 2
+	command->args = (char **)realloc(
+		command->args, sizeof(char *) * (command->arg_count += 2));
+
+	// shift everything forward by 1
+	for (int i = command->arg_count - 2; i > 0; --i) {
+		command->args[i] = command->args[i - 1];
+	}
+
+	// set args[0] as a copy of name
+	command->args[0] = strdup(command->name);
+
+	// set args[arg_count-1] (last) to NULL
+	command->args[command->arg_count - 1] = NULL;
+
+	return 0;
+}
+
+#undef malloc
+#undef realloc
+#undef strdup
+#undef free
+
+static double now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * Build a line of `stages` commands joined by pipes, each with `args` arguments
+ */
+static char *make_line(int stages, int args) {
+	size_t cap = (size_t)stages * (args * 12 + 16) + 1;
+	char *line = malloc(cap), *p = line;
+
+	for (int s = 0; s < stages; s++) {
+		p += sprintf(p, "%scmd%d", s ? " | " : "", s);
+		for (int a = 0; a < args; a++)
+			p += sprintf(p, " arg%d", a);
+	}
+	return line;
+}
+
+static void run(const char *label, int stages, int args, int iterations) {
+	char *line = make_line(stages, args);
+	size_t len = strlen(line);
+	char *buf = malloc(len + 1);
+	struct arena arena = {0};
+	double start;
+
+	allocator_calls = 0;
+	start = now_ns();
+	for (int i = 0; i < iterations; i++) {
+		memcpy(buf, line, len + 1);
+		struct command_t *command = calloc(1, sizeof(*command));
+		allocator_calls++;
+		legacy_parse_command(buf, command);
+		legacy_free_command(command);
+	}
+	double legacy_ns = (now_ns() - start) / iterations;
+	double legacy_calls = (double)allocator_calls / iterations;
+
+	start = now_ns();
+	for (int i = 0; i < iterations; i++) {
+		memcpy(buf, line, len + 1);
+		struct command_t *command = arena_calloc(&arena, sizeof(*command));
+		parse_command(buf, command, &arena);
+		arena_reset(&arena);
+	}
+	double arena_ns = (now_ns() - start) / iterations;
+
+	printf("%-22s %12.0f %12.0f %14.1f %14zu\n", label, legacy_ns, arena_ns,
+		   legacy_calls, arena.chunks);
+
+	arena_free(&arena);
+	free(buf);
+	free(line);
+}
+
+int main(int argc, char **argv) {
+	int iterations = argc > 1 ? atoi(argv[1]) : 2000;
+
+	printf("%-22s %12s %12s %14s %14s\n", "line", "legacy (ns)", "arena (ns)",
+		   "allocs/parse", "arena chunks");
+	run("1 stage, 4 args", 1, 4, iterations * 10);
+	run("1 stage, 256 args", 1, 256, iterations);
+	run("1 stage, 2048 args", 1, 2048, iterations / 4);
+	run("32 stages, 8 args", 32, 8, iterations);
+	run("256 stages, 2 args", 256, 2, iterations / 4);
+	return 0;
+}
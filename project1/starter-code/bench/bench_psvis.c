@@ -0,0 +1,211 @@
+/**
+ * psvis load test: spawn a synthetic process tree and time walks over it.
+ * Every process forks up to FANOUT children until the tree holds COUNT
+ * processes, so FANOUT 1 gives one long chain and a large FANOUT a wide,
+ * flat tree. The tree is walked through /proc/psvis when the module is
+ * loaded, and by scanning /proc/<pid>/stat for parent PIDs, the way a
+ * user-space tool without the module would have to, for comparison.
+ * Raise ulimit -u and kernel.pid_max first for large trees.
+ * Usage: bench_psvis [count] [fanout]
+ */
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+static int ready_pipe[2], release_pipe[2];
+
+static double now_s(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Become the root of a subtree of count processes: fork the children,
+ * report ready, and block until the bench lets go. A child that cannot
+ * be forked reports its whole share as failed, with '!' instead of '.'.
+ * Children start over instead of recursing, a chain of 50k processes
+ * would otherwise carry 50k stack frames at its end.
+ */
+static void grow(size_t count, size_t fanout) {
+	pid_t pids[fanout];
+	size_t spawned;
+
+start:
+	spawned = 0;
+	size_t rest = count - 1, children = rest < fanout ? rest : fanout;
+	for (size_t i = 0; i < children; i++) {
+		size_t share = rest / (children - i);
+		rest -= share;
+		pid_t pid = fork();
+		if (pid == 0) {
+			count = share;
+			goto start;
+		}
+		if (pid == -1) {
+			for (size_t j = 0; j < share; j++)
+				if (write(ready_pipe[1], "!", 1) == -1)
+					break;
+			continue;
+		}
+		pids[spawned++] = pid;
+	}
+	if (write(ready_pipe[1], ".", 1) == -1)
+		_exit(1);
+
+	char c;
+	while (read(release_pipe[0], &c, 1) == -1 && errno == EINTR)
+		;
+	for (size_t i = 0; i < spawned; i++)
+		waitpid(pids[i], NULL, 0);
+}
+
+// lines of /proc/psvis for the tree at root, -1 without the module
+static long walk_psvis(pid_t root) {
+	int fd = open("/proc/psvis", O_RDWR);
+	if (fd == -1)
+		return -1;
+	char request[32];
+	int len = snprintf(request, sizeof(request), "%d", (int)root);
+	if (write(fd, request, len) == -1) {
+		close(fd);
+		return -1;
+	}
+
+	static char buf[1 << 16];
+	long lines = 0;
+	ssize_t n;
+	while ((n = read(fd, buf, sizeof(buf))) > 0)
+		for (ssize_t i = 0; i < n; i++)
+			lines += buf[i] == '\n';
+	close(fd);
+	return lines;
+}
+
+static int by_parent(const void *a, const void *b) {
+	pid_t x = ((const pid_t *)a)[1], y = ((const pid_t *)b)[1];
+	return (x > y) - (x < y);
+}
+
+// size of the tree at root, from the parent PIDs of every process in /proc
+static long walk_procfs(pid_t root) {
+	size_t capacity = 1 << 16, count = 0;
+	pid_t (*pairs)[2] = malloc(capacity * sizeof(*pairs));
+	DIR *proc = opendir("/proc");
+	struct dirent *d;
+
+	while ((d = readdir(proc)) != NULL) {
+		if (!isdigit((unsigned char)d->d_name[0]))
+			continue;
+		char path[300], stat[512];
+		snprintf(path, sizeof(path), "/proc/%s/stat", d->d_name);
+		int fd = open(path, O_RDONLY);
+		if (fd == -1)
+			continue;
+		ssize_t n = read(fd, stat, sizeof(stat) - 1);
+		close(fd);
+		if (n <= 0)
+			continue;
+		stat[n] = '\0';
+		// the command name may hold anything, the fields resume after its ')'
+		char *p = strrchr(stat, ')');
+		int ppid;
+		if (!p || sscanf(p + 1, " %*c %d", &ppid) != 1)
+			continue;
+		if (count == capacity) {
+			capacity *= 2;
+			pairs = realloc(pairs, capacity * sizeof(*pairs));
+		}
+		pairs[count][0] = atoi(d->d_name);
+		pairs[count++][1] = ppid;
+	}
+	closedir(proc);
+
+	// sorted by parent, the children of each process are a range
+	qsort(pairs, count, sizeof(*pairs), by_parent);
+	pid_t *tree = malloc((count + 1) * sizeof(*tree));
+	size_t size = 1;
+	tree[0] = root;
+	for (size_t done = 0; done < size; done++) {
+		size_t lo = 0, hi = count;
+		while (lo < hi) {
+			size_t mid = (lo + hi) / 2;
+			if (pairs[mid][1] < tree[done])
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		for (; lo < count && pairs[lo][1] == tree[done] && size <= count; lo++)
+			tree[size++] = pairs[lo][0];
+	}
+	free(pairs);
+	free(tree);
+	return size;
+}
+
+int main(int argc, char **argv) {
+	size_t count = argc > 1 ? strtoul(argv[1], NULL, 10) : 50000;
+	size_t fanout = argc > 2 ? strtoul(argv[2], NULL, 10) : 8;
+	if (count < 1 || fanout < 1) {
+		fprintf(stderr, "Usage: bench_psvis [count] [fanout]\n");
+		return 1;
+	}
+	if (pipe(ready_pipe) == -1 || pipe(release_pipe) == -1) {
+		perror("pipe");
+		return 1;
+	}
+
+	double start = now_s();
+	pid_t root = fork();
+	if (root == 0) {
+		close(release_pipe[1]);
+		grow(count, fanout);
+		_exit(0);
+	}
+	if (root == -1) {
+		perror("fork");
+		return 1;
+	}
+	close(release_pipe[0]);
+	close(ready_pipe[1]);
+
+	size_t ready = 0, failed = 0;
+	char buf[4096];
+	ssize_t n;
+	while (ready + failed < count && (n = read(ready_pipe[0], buf, sizeof(buf))) > 0)
+		for (ssize_t i = 0; i < n; i++)
+			buf[i] == '.' ? ready++ : failed++;
+	printf("%zu processes spawned, %zu forks failed, fanout %zu, %.2f s\n", ready, failed, fanout,
+	       now_s() - start);
+
+	printf("%-14s %10s %10s\n", "walk", "processes", "ms");
+	double best = 1e9;
+	long lines = 0;
+	for (int run = 0; run < 5 && lines >= 0; run++) {
+		start = now_s();
+		lines = walk_psvis(root);
+		double t = now_s() - start;
+		if (t < best)
+			best = t;
+	}
+	if (lines >= 0)
+		printf("%-14s %10ld %10.2f\n", "/proc/psvis", lines, best * 1e3);
+	else
+		printf("%-14s %10s %10s   (module not loaded)\n", "/proc/psvis", "-", "-");
+
+	start = now_s();
+	long size = walk_procfs(root);
+	printf("%-14s %10ld %10.2f\n", "procfs scan", size, (now_s() - start) * 1e3);
+
+	// closing the last write end wakes the whole tree
+	close(release_pipe[1]);
+	waitpid(root, NULL, 0);
+	return 0;
+}
@@ -0,0 +1,73 @@
+/**
+ * Launch latency of fork+execvp (the old process_command path) against
+ * launch_spawn through the PATH cache, with the parent's resident set grown to various sizes.
+ * Usage: bench_spawn [iterations]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "launch.h"
+#include "pathcache.h"
+
+static double now_us(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static double run_fork(char **argv, int iterations) {
+	double start = now_us();
+	for (int i = 0; i < iterations; i++) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			execvp(argv[0], argv);
+			_exit(127);
+		}
+		waitpid(pid, NULL, 0);
+	}
+	return (now_us() - start) / iterations;
+}
+
+static double run_spawn(char **argv, int iterations) {
+	double start = now_us();
+	for (int i = 0; i < iterations; i++) {
+		const char *path = pathcache_lookup(argv[0]);
+		pid_t pid;
+		if (!path || launch_spawn(path, argv, -1, -1, 0, &pid) != 0) {
+			perror("launch_spawn");
+			exit(1);
+		}
+		waitpid(pid, NULL, 0);
+	}
+	return (now_us() - start) / iterations;
+}
+
+int main(int argc, char **argv) {
+	static const size_t sizes_mb[] = {0, 64, 256, 1024};
+	int iterations = argc > 1 ? atoi(argv[1]) : 200;
+	char *child[] = {"true", NULL};
+
+	printf("%10s %14s %14s %8s\n", "rss (MB)", "fork (us)", "spawn (us)", "ratio");
+	for (size_t i = 0; i < sizeof(sizes_mb) / sizeof(sizes_mb[0]); i++) {
+		size_t bytes = sizes_mb[i] << 20;
+		char *heap = NULL;
+		if (bytes) {
+			heap = malloc(bytes);
+			if (!heap) {
+				printf("%10zu    (allocation failed)\n", sizes_mb[i]);
+				continue;
+			}
+			memset(heap, 1, bytes); // fault every page in
+		}
+
+		double f = run_fork(child, iterations);
+		double s = run_spawn(child, iterations);
+		printf("%10zu %14.1f %14.1f %7.1fx\n", sizes_mb[i], f, s, f / s);
+		free(heap);
+	}
+	return 0;
+}
@@ -0,0 +1,90 @@
+/**
+ * Scaling of uniq -c -j N from one thread up to N, on a generated access
+ * log style file with many repeats. Every run's output is checked against
+ * the single-threaded one.
+ * Usage: bench_uniq [megabytes] [max threads] [distinct values]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hash.h"
+#include "uniq.h"
+
+static double now_s(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void write_input(const char *path, size_t bytes, unsigned distinct) {
+	FILE *f = fopen(path, "w");
+	size_t written = 0;
+
+	srand(1);
+	while (written < bytes) {
+		// skewed like real logs, a few values are very frequent
+		unsigned v = (unsigned)((double)rand() / RAND_MAX * rand() / RAND_MAX * distinct);
+		written += fprintf(f, "GET /api/v1/items/%u HTTP/1.1 200\n", v);
+	}
+	fclose(f);
+}
+
+/**
+ * Run uniq into a memory stream and hash what it printed
+ * @param  path [description]
+ * @param  opt  [description]
+ * @param  hash [description]
+ * @return      seconds
+ */
+static double run(const char *path, const struct uniq_options *opt, uint64_t *hash) {
+	char *buf;
+	size_t len;
+	FILE *out = open_memstream(&buf, &len);
+
+	double start = now_s();
+	uniq_file(path, opt, out);
+	fflush(out);
+	double t = now_s() - start;
+
+	*hash = hash_bytes(buf, len);
+	fclose(out);
+	free(buf);
+	return t;
+}
+
+int main(int argc, char **argv) {
+	size_t mb = argc > 1 ? strtoul(argv[1], NULL, 10) : 256;
+	long max_jobs = argc > 2 ? atol(argv[2]) : sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned distinct = argc > 3 ? strtoul(argv[3], NULL, 10) : 200000;
+	char path[] = "/tmp/bench_uniq_XXXXXX";
+	int fd = mkstemp(path);
+	if (fd == -1) {
+		perror("mkstemp");
+		return 1;
+	}
+	close(fd);
+	write_input(path, mb << 20, distinct);
+	if (max_jobs < 2)
+		max_jobs = 2;
+
+	struct uniq_options opt = {.count = true};
+	uint64_t expected, hash;
+	double base = run(path, &opt, &expected);
+
+	printf("%zu MB, up to %u distinct lines, %ld online CPUs\n", mb, distinct,
+		   sysconf(_SC_NPROCESSORS_ONLN));
+	printf("%8s %10s %10s %9s %s\n", "threads", "seconds", "MB/s", "speedup", "output");
+	printf("%8d %10.3f %10.0f %8.2fx %s\n", 1, base, mb / base, 1.0, "reference");
+	for (int jobs = 2; jobs <= max_jobs; jobs++) {
+		opt.jobs = jobs;
+		double t = run(path, &opt, &hash);
+		printf("%8d %10.3f %10.0f %8.2fx %s\n", jobs, t, mb / t, base / t,
+			   hash == expected ? "identical" : "DIFFERENT");
+	}
+
+	unlink(path);
+	return 0;
+}
@@ -1,45 +1,368 @@
+#include <linux/bsearch.h>
 #include <linux/init.h>
 #include <linux/kernel.h>
+#include <linux/mm.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/pid.h>
+#include <linux/proc_fs.h>
 #include <linux/sched/signal.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/uaccess.h>
+#include <linux/version.h>
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Mehmet Furkan Geçkil");
 MODULE_DESCRIPTION("Module for visualizing process trees");
 
+/*
+ * The tree is read from /proc/psvis. Writing "PID [MAX]" to the file
+ * selects the root, and optionally how many processes to list at most, for
+ * the reads that follow on the same descriptor only. A query on a fresh
+ * descriptor is a write and reads; one descriptor serves several queries
+ * with an lseek to 0 after each write:
+ *
+ *   fd = open("/proc/psvis", O_RDWR); write(fd, "42 1000", 7); read(fd, ...)
+ *   write(fd, "43", 2); lseek(fd, 0, SEEK_SET); read(fd, ...)
+ *
+ * A plain cat shows the tree under the pid module parameter, which only
+ * root can change. Reading from the top takes a new snapshot of the
+ * processes, the rest of the reads walk it. Nothing goes through the
+ * kernel log.
+ */
+
+#define PSVIS_NAME "psvis"
+// deeper levels are left out, which also bounds the indentation
+#define PSVIS_MAX_DEPTH 512
+
 static int pid = 1; // Default to PID 1 (init process)
 
 module_param(pid, int, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
 MODULE_PARM_DESC(pid, "PID of the root process");
 
-static void print_process_tree(struct task_struct *task, int level) {
-    struct task_struct *child;
-    struct list_head *list;
-    
-    printk(KERN_INFO "%*s%s [%d]\n", level * 2, "", task->comm, task->pid);
-    list_for_each(list, &task->children) {
-        child = list_entry(list, struct task_struct, sibling);
-        print_process_tree(child, level + 1);
+static unsigned int max_tasks = 1 << 17;
+
+module_param(max_tasks, uint, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+MODULE_PARM_DESC(max_tasks, "Most processes listed by one read, unless the reader asks for fewer");
+
+static struct proc_dir_entry *psvis_entry;
+
+#define PSVIS_NONE U32_MAX
+
+// one process of a snapshot, linked to its parent and children by index
+struct psvis_proc {
+    pid_t pid, ppid;
+    u32 parent, first_child, next_sibling;
+    char comm[TASK_COMM_LEN];
+};
+
+struct psvis_snapshot {
+    struct psvis_proc *procs; // sorted by pid
+    u32 count;
+    bool partial; // more processes appeared than there was room for
+};
+
+static int psvis_by_pid(const void *a, const void *b) {
+    const struct psvis_proc *x = a, *y = b;
+    return (x->pid > y->pid) - (x->pid < y->pid);
+}
+
+static u32 psvis_find(const struct psvis_snapshot *snap, pid_t pid) {
+    struct psvis_proc key = {.pid = pid};
+    struct psvis_proc *p = bsearch(&key, snap->procs, snap->count, sizeof(key), psvis_by_pid);
+    return p ? p - snap->procs : PSVIS_NONE;
+}
+
+/**
+ * Copy the PID, parent and name of every process. The children lists are
+ * tasklist_lock's, which modules cannot take, and are not safe to walk
+ * under RCU alone; the list of all processes is, and for_each_process
+ * over it with pid_alive() checks sees every live process exactly once.
+ * The tree is then built from the copies, where nothing can change under
+ * the walk. A process that forks or exits meanwhile may be missed or
+ * show up with its new parent, but every link is a real one.
+ * @return 0, or -ENOMEM
+ */
+static int psvis_take_snapshot(struct psvis_snapshot *snap) {
+    struct task_struct *p;
+    u32 capacity = 0, n = 0, i;
+
+    rcu_read_lock();
+    for_each_process(p)
+        capacity++;
+    rcu_read_unlock();
+    // room for processes forked before the second pass
+    capacity += capacity / 8 + 64;
+
+    snap->procs = kvmalloc_array(capacity, sizeof(*snap->procs), GFP_KERNEL);
+    if (!snap->procs)
+        return -ENOMEM;
+    snap->partial = false;
+
+    rcu_read_lock();
+    for_each_process(p) {
+        struct psvis_proc *e = &snap->procs[n];
+
+        if (!pid_alive(p))
+            continue;
+        if (n == capacity) {
+            snap->partial = true;
+            break;
+        }
+        e->pid = task_pid_vnr(p);
+        // the parent may be any thread, the tree is one of thread group leaders
+        e->ppid = task_tgid_vnr(rcu_dereference(p->real_parent));
+        if (!e->pid)
+            continue; // outside our PID namespace
+        get_task_comm(e->comm, p);
+        n++;
+    }
+    rcu_read_unlock();
+    snap->count = n;
+
+    sort(snap->procs, n, sizeof(*snap->procs), psvis_by_pid, NULL);
+    for (i = 0; i < n; i++)
+        snap->procs[i].parent = snap->procs[i].first_child = snap->procs[i].next_sibling = PSVIS_NONE;
+    // backwards, so that prepending leaves the children in PID order
+    for (i = n; i-- > 0;) {
+        struct psvis_proc *e = &snap->procs[i];
+        u32 parent = psvis_find(snap, e->ppid);
+
+        if (parent == PSVIS_NONE || parent == i)
+            continue;
+        e->parent = parent;
+        e->next_sibling = snap->procs[parent].first_child;
+        snap->procs[parent].first_child = i;
+    }
+    return 0;
+}
+
+/**
+ * Make a process the root: unlink it from its parent, so a walk from it
+ * can neither climb above it nor, with PIDs reused between the two passes
+ * of the snapshot, come back to it through a cycle
+ */
+static void psvis_make_root(struct psvis_snapshot *snap, u32 root) {
+    u32 parent = snap->procs[root].parent;
+    u32 *link;
+
+    if (parent == PSVIS_NONE)
+        return;
+    for (link = &snap->procs[parent].first_child; *link != root; link = &snap->procs[*link].next_sibling)
+        ;
+    *link = snap->procs[root].next_sibling;
+    snap->procs[root].parent = snap->procs[root].next_sibling = PSVIS_NONE;
+}
+
+/*
+ * The state of one open file: what the reader asked for, and a cursor of
+ * the depth-first walk over the snapshot. seq_file asks for records by
+ * position; the cursor stays where the last one was, so the next is one
+ * step away, and only a seek back starts the walk over from the root.
+ */
+struct psvis_state {
+    struct mutex lock; // start to stop, and a write
+    int root_pid;
+    unsigned int max;
+    bool stale; // the next read from the top takes a new snapshot
+
+    struct psvis_snapshot snap;
+    u32 root;         // in snap, PSVIS_NONE if it is not there
+    loff_t pos;       // record of the cursor
+    u32 cur;          // process at pos, PSVIS_NONE past the last
+    unsigned int depth;
+    bool cut;         // processes were left out
+};
+
+static void psvis_rewind(struct psvis_state *s) {
+    s->pos = 0;
+    s->cur = s->root;
+    s->depth = 0;
+    s->cut = false;
+}
+
+/**
+ * Move the cursor to the next process in depth-first order, through the
+ * parent links instead of a stack
+ */
+static void psvis_advance(struct psvis_state *s) {
+    struct psvis_proc *procs = s->snap.procs;
+    u32 cur = s->cur;
+
+    if (procs[cur].first_child != PSVIS_NONE) {
+        if (s->depth < PSVIS_MAX_DEPTH) {
+            s->cur = procs[cur].first_child;
+            s->depth++;
+            return;
+        }
+        s->cut = true;
     }
+    while (cur != s->root && procs[cur].next_sibling == PSVIS_NONE) {
+        cur = procs[cur].parent;
+        s->depth--;
+    }
+    s->cur = cur == s->root ? PSVIS_NONE : procs[cur].next_sibling;
+}
+
+/**
+ * @return the process at a position, the state itself for the closing
+ *         line of a partial tree or a missing root, NULL past the end
+ */
+static void *psvis_at(struct psvis_state *s, loff_t pos) {
+    if (pos < s->pos)
+        psvis_rewind(s);
+    while (s->pos < pos && s->cur != PSVIS_NONE) {
+        psvis_advance(s);
+        s->pos++;
+        if (s->cur != PSVIS_NONE && s->pos == s->max) {
+            s->cur = PSVIS_NONE;
+            s->cut = true;
+        }
+    }
+    if (s->cur != PSVIS_NONE)
+        return &s->snap.procs[s->cur];
+    if (pos == s->pos && (s->root == PSVIS_NONE || s->cut || s->snap.partial))
+        return s;
+    return NULL;
+}
+
+static void *psvis_start(struct seq_file *m, loff_t *pos) {
+    struct psvis_state *s = m->private;
+    int err;
+
+    mutex_lock(&s->lock);
+    if (*pos == 0 && s->stale) {
+        kvfree(s->snap.procs);
+        s->snap.procs = NULL;
+        err = psvis_take_snapshot(&s->snap);
+        if (err)
+            return ERR_PTR(err);
+        s->root = psvis_find(&s->snap, s->root_pid);
+        if (s->root != PSVIS_NONE)
+            psvis_make_root(&s->snap, s->root);
+        psvis_rewind(s);
+        s->stale = false;
+    }
+    if (!s->snap.procs)
+        return NULL;
+    return psvis_at(s, *pos);
 }
 
+static void *psvis_next(struct seq_file *m, void *v, loff_t *pos) {
+    struct psvis_state *s = m->private;
+
+    ++*pos;
+    return v == s ? NULL : psvis_at(s, *pos);
+}
+
+static void psvis_stop(struct seq_file *m, void *v) {
+    struct psvis_state *s = m->private;
+
+    // past the end, a seek back to the top asks for the tree anew
+    if (!v)
+        s->stale = true;
+    mutex_unlock(&s->lock);
+}
+
+static int psvis_show(struct seq_file *m, void *v) {
+    struct psvis_state *s = m->private;
+    struct psvis_proc *p = v;
+
+    if (v != s)
+        seq_printf(m, "%*s%s [%d]\n", s->depth * 2, "", p->comm, p->pid);
+    else if (s->root == PSVIS_NONE)
+        seq_printf(m, "No such PID: %d\n", s->root_pid);
+    else
+        seq_printf(m, "... partial tree: %lld processes listed, at most %u levels\n", s->pos,
+                   PSVIS_MAX_DEPTH);
+    return 0;
+}
+
+static const struct seq_operations psvis_seq_ops = {
+    .start = psvis_start,
+    .next = psvis_next,
+    .stop = psvis_stop,
+    .show = psvis_show,
+};
+
+static int psvis_open(struct inode *inode, struct file *file) {
+    struct psvis_state *s = __seq_open_private(file, &psvis_seq_ops, sizeof(*s));
+
+    if (!s)
+        return -ENOMEM;
+    mutex_init(&s->lock);
+    s->root_pid = READ_ONCE(pid);
+    s->max = READ_ONCE(max_tasks);
+    s->stale = true;
+    return 0;
+}
+
+static int psvis_release(struct inode *inode, struct file *file) {
+    struct psvis_state *s = ((struct seq_file *)file->private_data)->private;
+
+    kvfree(s->snap.procs);
+    mutex_destroy(&s->lock);
+    return seq_release_private(inode, file);
+}
+
+static ssize_t psvis_write(struct file *file, const char __user *buf, size_t count, loff_t *ppos) {
+    struct psvis_state *s = ((struct seq_file *)file->private_data)->private;
+    char kbuf[32];
+    unsigned int max = READ_ONCE(max_tasks);
+    int root;
+
+    if (count >= sizeof(kbuf))
+        return -EINVAL;
+    if (copy_from_user(kbuf, buf, count))
+        return -EFAULT;
+    kbuf[count] = '\0';
+    if (sscanf(kbuf, "%d %u", &root, &max) < 1 || root <= 0 || max == 0)
+        return -EINVAL;
+    if (max > READ_ONCE(max_tasks))
+        max = READ_ONCE(max_tasks);
+
+    // takes effect with the next read from the top, a fresh open or lseek to 0
+    mutex_lock(&s->lock);
+    s->root_pid = root;
+    s->max = max;
+    s->stale = true;
+    mutex_unlock(&s->lock);
+    return count;
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 6, 0)
+static const struct proc_ops psvis_ops = {
+    .proc_open = psvis_open,
+    .proc_read = seq_read,
+    .proc_write = psvis_write,
+    .proc_lseek = seq_lseek,
+    .proc_release = psvis_release,
+};
+#else
+static const struct file_operations psvis_ops = {
+    .owner = THIS_MODULE,
+    .open = psvis_open,
+    .read = seq_read,
+    .write = psvis_write,
+    .llseek = seq_lseek,
+    .release = psvis_release,
+};
+#endif
+
 static int __init psvis_init(void) {
-    struct pid *pid_struct;
-    struct task_struct *task;
-    
-    printk(KERN_INFO "Loading psvis Module for PID: %d\n", pid);
-    pid_struct = find_get_pid(pid);
-    task = pid_task(pid_struct, PIDTYPE_PID);
-    if (task) {
-        print_process_tree(task, 0);
-    } else {
-        printk(KERN_INFO "No such PID: %d\n", pid);
+    psvis_entry = proc_create(PSVIS_NAME, 0666, NULL, &psvis_ops);
+    if (!psvis_entry) {
+        printk(KERN_ERR "psvis: cannot create /proc/%s\n", PSVIS_NAME);
+        return -ENOMEM;
     }
+    printk(KERN_INFO "Loading psvis Module, default PID: %d\n", pid);
     return 0;
 }
 
 static void __exit psvis_exit(void) {
+    proc_remove(psvis_entry);
     printk(KERN_INFO "Removing psvis Module\n");
 }
 
@@ -0,0 +1,78 @@
+#include <stdalign.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+#define ARENA_ALIGN alignof(max_align_t)
+
+static struct arena_chunk *new_chunk(struct arena *a, size_t size) {
+	if (size < ARENA_CHUNK_SIZE)
+		size = ARENA_CHUNK_SIZE;
+	struct arena_chunk *c = malloc(sizeof(*c) + size);
+	if (!c)
+		abort();
+	c->next = NULL;
+	c->size = size;
+	a->chunks++;
+	return c;
+}
+
+void *arena_alloc(struct arena *a, size_t size) {
+	size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+	if (!a->current) {
+		if (!a->head)
+			a->head = new_chunk(a, size);
+		a->current = a->head;
+		a->used = 0;
+	}
+
+	if (a->used + size > a->current->size) {
+		// reuse the chunks left over from before the last reset if they fit
+		struct arena_chunk *next = a->current->next;
+		if (!next || next->size < size) {
+			struct arena_chunk *c = new_chunk(a, size);
+			c->next = next;
+			a->current->next = c;
+			next = c;
+		}
+		a->current = next;
+		a->used = 0;
+	}
+
+	void *p = a->current->data + a->used;
+	a->used += size;
+	return p;
+}
+
+void *arena_calloc(struct arena *a, size_t size) {
+	return memset(arena_alloc(a, size), 0, size);
+}
+
+char *arena_strndup(struct arena *a, const char *s, size_t len) {
+	char *p = arena_alloc(a, len + 1);
+	memcpy(p, s, len);
+	p[len] = 0;
+	return p;
+}
+
+char *arena_strdup(struct arena *a, const char *s) {
+	return arena_strndup(a, s, strlen(s));
+}
+
+void arena_reset(struct arena *a) {
+	a->current = a->head;
+	a->used = 0;
+}
+
+void arena_free(struct arena *a) {
+	struct arena_chunk *c = a->head;
+	while (c) {
+		struct arena_chunk *next = c->next;
+		free(c);
+		c = next;
+	}
+	a->head = a->current = NULL;
+	a->used = 0;
+}
@@ -0,0 +1,65 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/**
+ * Bump allocator. Allocations are never freed one by one, the whole arena
+ * is rewound at once when everything in it dies together.
+ */
+struct arena_chunk {
+	struct arena_chunk *next;
+	size_t size;
+	char data[];
+};
+
+struct arena {
+	struct arena_chunk *head;    // first chunk, kept across resets
+	struct arena_chunk *current; // chunk being filled
+	size_t used;                 // bytes used in current
+	size_t chunks;               // chunks malloc'd over the arena's lifetime
+};
+
+#define ARENA_CHUNK_SIZE 8192
+
+/**
+ * Allocate memory aligned for any type
+ * @param  a    [description]
+ * @param  size [description]
+ * @return      [description]
+ */
+void *arena_alloc(struct arena *a, size_t size);
+
+/**
+ * Allocate zeroed memory aligned for any type
+ * @param  a    [description]
+ * @param  size [description]
+ * @return      [description]
+ */
+void *arena_calloc(struct arena *a, size_t size);
+
+/**
+ * Copy len bytes of s into the arena, NUL terminated
+ * @param  a   [description]
+ * @param  s   [description]
+ * @param  len [description]
+ * @return     [description]
+ */
+char *arena_strndup(struct arena *a, const char *s, size_t len);
+
+char *arena_strdup(struct arena *a, const char *s);
+
+/**
+ * Release everything allocated so far in O(1). The chunks stay around
+ * and are reused by later allocations.
+ * @param a [description]
+ */
+void arena_reset(struct arena *a);
+
+/**
+ * Give all chunks back to malloc
+ * @param a [description]
+ */
+void arena_free(struct arena *a);
+
+#endif
@@ -0,0 +1,422 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "hash.h"
+#include "hdiff.h"
+
+/*
+ * Delta encoding in the manner of rsync. The old file is cut into blocks
+ * that are indexed by a weak checksum. A window of one block then rolls
+ * over the new file a byte at a time, and wherever its checksum finds an
+ * old block with the same bytes, that match is grown in both directions
+ * and sent as a copy. Everything in between is sent as a literal. Unlike
+ * rsync both files are at hand, so candidates are verified with memcmp
+ * instead of a strong checksum.
+ *
+ * A patch is a header followed by operations, numbers are LEB128:
+ *   "HDELTA1\n" old size, old hash, new size
+ *   'C' offset length   copy from the old file
+ *   'L' length bytes    literal
+ *   'E'                 end
+ */
+
+#define DELTA_MAGIC "HDELTA1\n"
+#define DELTA_MIN_BLOCK 64
+#define DELTA_MAX_BLOCK 4096
+
+struct blob {
+	const unsigned char *data;
+	size_t size;
+	bool mapped;
+};
+
+/**
+ * Map a file, or read it whole if it cannot be mapped
+ * @return 0, or -1 with errno set
+ */
+static int blob_load(struct blob *b, const char *path) {
+	struct stat st;
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+	memset(b, 0, sizeof(*b));
+	if (fd == -1)
+		return -1;
+	if (fstat(fd, &st) == -1)
+		goto fail;
+
+	if (S_ISREG(st.st_mode) && st.st_size > 0) {
+		void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map != MAP_FAILED) {
+			b->data = map;
+			b->size = st.st_size;
+			b->mapped = true;
+		}
+	}
+	if (!b->mapped) {
+		size_t capacity = 1024 * 1024;
+		unsigned char *data = malloc(capacity);
+		ssize_t n;
+		if (!data) {
+			errno = ENOMEM;
+			goto fail;
+		}
+		b->data = data;
+		while ((n = read(fd, data + b->size, capacity - b->size)) != 0) {
+			if (n == -1) {
+				if (errno == EINTR)
+					continue;
+				goto fail;
+			}
+			b->size += n;
+			if (b->size == capacity) {
+				if (capacity > SIZE_MAX / 2 || !(data = realloc(data, capacity * 2))) {
+					errno = ENOMEM;
+					goto fail;
+				}
+				capacity *= 2;
+				b->data = data;
+			}
+		}
+	}
+	close(fd);
+	return 0;
+
+fail:;
+	int saved = errno;
+	if (!b->mapped)
+		free((void *)b->data);
+	b->data = NULL;
+	close(fd);
+	errno = saved;
+	return -1;
+}
+
+static void blob_free(struct blob *b) {
+	if (b->mapped)
+		munmap((void *)b->data, b->size);
+	else
+		free((void *)b->data);
+}
+
+/**
+ * rsync picks blocks around the square root of the file size, which keeps
+ * the index and the literal left around each change about equally small.
+ * A quarter of that is used here: the index stays local, and only a block
+ * that lies wholly between two edits can match, so edits a few kilobytes
+ * apart would otherwise leave nothing to copy.
+ */
+static size_t block_size(size_t old_size) {
+	size_t block = (size_t)sqrt((double)old_size) / 4 & ~(size_t)7;
+	if (block < DELTA_MIN_BLOCK)
+		block = DELTA_MIN_BLOCK;
+	if (block > DELTA_MAX_BLOCK)
+		block = DELTA_MAX_BLOCK;
+	return block;
+}
+
+/*
+ * The rolling checksum, two running sums as in rsync but without the
+ * reduction mod 2^16: a is the sum of the window, b the sum of its
+ * prefix sums. Both roll in O(1) per byte.
+ */
+struct rolling {
+	uint32_t a, b;
+};
+
+static struct rolling rolling_init(const unsigned char *p, size_t block) {
+	struct rolling r = {0, 0};
+	for (size_t i = 0; i < block; i++) {
+		r.a += p[i];
+		r.b += r.a;
+	}
+	return r;
+}
+
+static inline void rolling_roll(struct rolling *r, unsigned char out, unsigned char in, size_t block) {
+	r->a += in - out;
+	r->b += r->a - (uint32_t)block * out;
+}
+
+static inline uint64_t rolling_key(struct rolling r) {
+	return (uint64_t)r.b << 32 | r.a;
+}
+
+/*
+ * Most windows of the new file match nothing, so lookups are mostly
+ * misses. They go to a bitmap with at most one bit in sixteen set first,
+ * which answers them without touching the table, and more importantly
+ * without a hard to predict branch per byte, as rsync's tag table does.
+ */
+struct block_index {
+	uint64_t *keys;
+	uint32_t *blocks; // block number + 1, 0 for empty slots
+	size_t mask;
+	int shift;
+	uint64_t *filter;
+	int filter_shift;
+};
+
+static inline uint64_t index_hash(uint64_t key) {
+	return key * 0x9e3779b97f4a7c15ULL;
+}
+
+static void index_free(struct block_index *x) {
+	free(x->keys);
+	free(x->blocks);
+	free(x->filter);
+}
+
+/**
+ * Index every whole block of the old file by its checksum. Only the first
+ * block of each checksum is kept: matches grow past block boundaries, so
+ * repeated content such as runs of zeros loses nothing, and lookups never
+ * walk long chains of equal keys.
+ * @return 0, or -1 with errno ENOMEM
+ */
+static int index_build(struct block_index *x, const unsigned char *old, size_t size, size_t block) {
+	size_t blocks = size / block, capacity = 16;
+	x->shift = 64 - 4;
+	while (capacity < 2 * blocks) {
+		capacity *= 2;
+		x->shift--;
+	}
+	// 8 filter bits per slot, at least 16 per block
+	x->filter_shift = x->shift - 3;
+
+	x->keys = malloc(capacity * sizeof(*x->keys));
+	x->blocks = calloc(capacity, sizeof(*x->blocks));
+	x->filter = calloc(capacity / 8, sizeof(*x->filter));
+	if (!x->keys || !x->blocks || !x->filter) {
+		index_free(x);
+		errno = ENOMEM;
+		return -1;
+	}
+	x->mask = capacity - 1;
+	for (size_t i = 0; i < blocks; i++) {
+		uint64_t key = rolling_key(rolling_init(old + i * block, block));
+		uint64_t h = index_hash(key);
+		x->filter[h >> x->filter_shift >> 6] |= 1ULL << (h >> x->filter_shift & 63);
+		size_t slot = h >> x->shift;
+		while (x->blocks[slot] && x->keys[slot] != key)
+			slot = (slot + 1) & x->mask;
+		if (!x->blocks[slot]) {
+			x->keys[slot] = key;
+			x->blocks[slot] = i + 1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * @return the block with this checksum, -1 if there is none
+ */
+static inline long index_find(const struct block_index *x, uint64_t key) {
+	uint64_t h = index_hash(key);
+	if (__builtin_expect(!(x->filter[h >> x->filter_shift >> 6] >> (h >> x->filter_shift & 63) & 1), 1))
+		return -1;
+	size_t slot = h >> x->shift;
+	while (x->blocks[slot]) {
+		if (x->keys[slot] == key)
+			return (long)x->blocks[slot] - 1;
+		slot = (slot + 1) & x->mask;
+	}
+	return -1;
+}
+
+/**
+ * Length of the common prefix of a and b, up to n bytes
+ */
+static size_t common_prefix(const unsigned char *a, const unsigned char *b, size_t n) {
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		uint64_t x, y;
+		memcpy(&x, a + i, 8);
+		memcpy(&y, b + i, 8);
+		if (x != y)
+			return i + __builtin_ctzll(x ^ y) / 8;
+	}
+	while (i < n && a[i] == b[i])
+		i++;
+	return i;
+}
+
+static void put_number(uint64_t n, FILE *out) {
+	unsigned char buf[10];
+	size_t len = 0;
+	do {
+		buf[len] = n & 0x7f;
+		n >>= 7;
+		buf[len++] |= n ? 0x80 : 0;
+	} while (n);
+	fwrite(buf, 1, len, out);
+}
+
+static void put_literal(const unsigned char *p, size_t len, FILE *out) {
+	if (!len)
+		return;
+	putc('L', out);
+	put_number(len, out);
+	fwrite(p, 1, len, out);
+}
+
+/**
+ * @return 0, or -1 with errno ENOMEM if the old file cannot be indexed
+ */
+static int encode(const struct blob *old, const struct blob *new, FILE *out) {
+	size_t block = block_size(old->size);
+	struct block_index x;
+	const unsigned char *n = new->data;
+	size_t literal = 0, p = 0;
+
+	if (index_build(&x, old->data, old->size, block) == -1)
+		return -1;
+	fputs(DELTA_MAGIC, out);
+	put_number(old->size, out);
+	put_number(hash_bytes(old->data, old->size), out);
+	put_number(new->size, out);
+
+	if (old->size >= block && new->size >= block) {
+		struct rolling r = rolling_init(n, block);
+		while (1) {
+			long k = index_find(&x, rolling_key(r));
+			if (k >= 0 && memcmp(old->data + (size_t)k * block, n + p, block) == 0) {
+				// grow the match backwards into the pending literal, then forwards
+				size_t start = p, from = (size_t)k * block;
+				while (start > literal && from > 0 && old->data[from - 1] == n[start - 1])
+					start--, from--;
+				size_t len = p + block - start;
+				len += common_prefix(old->data + from + len, n + start + len,
+						     old->size - from - len < new->size - start - len
+							     ? old->size - from - len
+							     : new->size - start - len);
+
+				put_literal(n + literal, start - literal, out);
+				putc('C', out);
+				put_number(from, out);
+				put_number(len, out);
+				p = literal = start + len;
+				if (p + block > new->size)
+					break;
+				r = rolling_init(n + p, block);
+				continue;
+			}
+			if (p + block >= new->size)
+				break;
+			rolling_roll(&r, n[p], n[p + block], block);
+			p++;
+		}
+	}
+	put_literal(n + literal, new->size - literal, out);
+	putc('E', out);
+
+	index_free(&x);
+	return 0;
+}
+
+int hdiff_delta(const char *old_path, const char *new_path, FILE *out) {
+	struct blob old, new;
+
+	if (blob_load(&old, old_path) == -1)
+		return -1;
+	if (blob_load(&new, new_path) == -1) {
+		int saved = errno;
+		blob_free(&old);
+		errno = saved;
+		return -1;
+	}
+	int r = encode(&old, &new, out);
+	int saved = errno;
+	blob_free(&old);
+	blob_free(&new);
+	errno = saved;
+	return r == -1 || ferror(out) ? -1 : 0;
+}
+
+/**
+ * Read a number of the patch
+ * @return false if the patch ends first
+ */
+static bool get_number(const unsigned char **p, const unsigned char *end, uint64_t *n) {
+	*n = 0;
+	for (int shift = 0; *p < end && shift < 64; shift += 7) {
+		unsigned char c = *(*p)++;
+		*n |= (uint64_t)(c & 0x7f) << shift;
+		if (!(c & 0x80))
+			return true;
+	}
+	return false;
+}
+
+/**
+ * Rebuild the new file
+ * @return 0, or -1 with errno EINVAL for a corrupt patch or the wrong old file
+ */
+static int apply(const struct blob *old, const struct blob *patch, FILE *out) {
+	const unsigned char *p = patch->data, *end = p + patch->size;
+	uint64_t old_size, old_hash, new_size, written = 0;
+
+	if (patch->size < strlen(DELTA_MAGIC) || memcmp(p, DELTA_MAGIC, strlen(DELTA_MAGIC)) != 0)
+		goto corrupt;
+	p += strlen(DELTA_MAGIC);
+	if (!get_number(&p, end, &old_size) || !get_number(&p, end, &old_hash) ||
+	    !get_number(&p, end, &new_size))
+		goto corrupt;
+	if (old_size != old->size || old_hash != hash_bytes(old->data, old->size))
+		goto corrupt;
+
+	while (p < end) {
+		uint64_t a, b;
+		switch (*p++) {
+		case 'C':
+			if (!get_number(&p, end, &a) || !get_number(&p, end, &b) || a > old->size ||
+			    b > old->size - a)
+				goto corrupt;
+			fwrite(old->data + a, 1, b, out);
+			written += b;
+			break;
+		case 'L':
+			if (!get_number(&p, end, &a) || a > (uint64_t)(end - p))
+				goto corrupt;
+			fwrite(p, 1, a, out);
+			p += a;
+			written += a;
+			break;
+		case 'E':
+			if (written != new_size)
+				goto corrupt;
+			return ferror(out) ? -1 : 0;
+		default:
+			goto corrupt;
+		}
+	}
+
+corrupt:
+	errno = EINVAL;
+	return -1;
+}
+
+int hdiff_apply(const char *old_path, const char *patch_path, FILE *out) {
+	struct blob old, patch;
+
+	if (blob_load(&old, old_path) == -1)
+		return -1;
+	if (blob_load(&patch, patch_path) == -1) {
+		int saved = errno;
+		blob_free(&old);
+		errno = saved;
+		return -1;
+	}
+	int r = apply(&old, &patch, out);
+	int saved = errno;
+	blob_free(&old);
+	blob_free(&patch);
+	errno = saved;
+	return r;
+}
@@ -0,0 +1,268 @@
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "diff.h"
+
+struct diff_context {
+	const uint32_t *a, *b;
+	bool *changed_a, *changed_b;
+	long *fd, *bd;     // furthest reaching x per diagonal, forward and back
+	long too_expensive; // edit cost past which a split need not be optimal
+	uint32_t *count_a, *count_b; // occurrences per id, patience only
+	long *where_b;     // position of a unique line in b, patience only
+};
+
+/**
+ * Find the midpoint of a shortest edit script of a[xoff, xlim) and
+ * b[yoff, ylim), searching from both ends at once. Both ranges are
+ * non-empty and their first and last lines differ.
+ */
+static void split(struct diff_context *c, long xoff, long xlim, long yoff, long ylim,
+				  long *xmid, long *ymid) {
+	const uint32_t *a = c->a, *b = c->b;
+	long *fd = c->fd, *bd = c->bd;
+	long dmin = xoff - ylim, dmax = xlim - yoff;
+	long fmid = xoff - yoff, bmid = xlim - ylim;
+	long fmin = fmid, fmax = fmid, bmin = bmid, bmax = bmid;
+	bool odd = (fmid - bmid) & 1;
+
+	fd[fmid] = xoff;
+	bd[bmid] = xlim;
+
+	for (long cost = 1;; cost++) {
+		// one more step forward on every diagonal in reach
+		if (fmin > dmin)
+			fd[--fmin - 1] = -1;
+		else
+			fmin++;
+		if (fmax < dmax)
+			fd[++fmax + 1] = -1;
+		else
+			fmax--;
+		for (long d = fmax; d >= fmin; d -= 2) {
+			long lo = fd[d - 1], hi = fd[d + 1];
+			long x = lo >= hi ? lo + 1 : hi, y = x - d;
+			while (x < xlim && y < ylim && a[x] == b[y])
+				x++, y++;
+			fd[d] = x;
+			if (odd && bmin <= d && d <= bmax && bd[d] <= x) {
+				*xmid = x;
+				*ymid = y;
+				return;
+			}
+		}
+
+		// and one more backward
+		if (bmin > dmin)
+			bd[--bmin - 1] = LONG_MAX;
+		else
+			bmin++;
+		if (bmax < dmax)
+			bd[++bmax + 1] = LONG_MAX;
+		else
+			bmax--;
+		for (long d = bmax; d >= bmin; d -= 2) {
+			long lo = bd[d - 1], hi = bd[d + 1];
+			long x = lo < hi ? lo : hi - 1, y = x - d;
+			while (x > xoff && y > yoff && a[x - 1] == b[y - 1])
+				x--, y--;
+			bd[d] = x;
+			if (!odd && fmin <= d && d <= fmax && x <= fd[d]) {
+				*xmid = x;
+				*ymid = y;
+				return;
+			}
+		}
+
+		if (cost < c->too_expensive)
+			continue;
+
+		// too costly to find the best split, take whichever end got furthest
+		long fxybest = -1, fxbest = 0, bxybest = LONG_MAX, bxbest = 0;
+		for (long d = fmax; d >= fmin; d -= 2) {
+			long x = fd[d] < xlim ? fd[d] : xlim, y = x - d;
+			if (y > ylim)
+				x = ylim + d, y = ylim;
+			if (x + y > fxybest)
+				fxybest = x + y, fxbest = x;
+		}
+		for (long d = bmax; d >= bmin; d -= 2) {
+			long x = bd[d] > xoff ? bd[d] : xoff, y = x - d;
+			if (y < yoff)
+				x = yoff + d, y = yoff;
+			if (x + y < bxybest)
+				bxybest = x + y, bxbest = x;
+		}
+		if ((xlim + ylim) - bxybest < fxybest - (xoff + yoff)) {
+			*xmid = fxbest;
+			*ymid = fxybest - fxbest;
+		} else {
+			*xmid = bxbest;
+			*ymid = bxybest - bxbest;
+		}
+		return;
+	}
+}
+
+static void myers(struct diff_context *c, long xoff, long xlim, long yoff, long ylim) {
+	while (1) {
+		while (xoff < xlim && yoff < ylim && c->a[xoff] == c->b[yoff])
+			xoff++, yoff++;
+		while (xlim > xoff && ylim > yoff && c->a[xlim - 1] == c->b[ylim - 1])
+			xlim--, ylim--;
+
+		if (xoff == xlim) {
+			while (yoff < ylim)
+				c->changed_b[yoff++] = true;
+			return;
+		}
+		if (yoff == ylim) {
+			while (xoff < xlim)
+				c->changed_a[xoff++] = true;
+			return;
+		}
+
+		long xmid, ymid;
+		split(c, xoff, xlim, yoff, ylim, &xmid, &ymid);
+		// recurse into the smaller half, loop on the other
+		if (xmid - xoff + ymid - yoff < xlim - xmid + ylim - ymid) {
+			myers(c, xoff, xmid, yoff, ymid);
+			xoff = xmid, yoff = ymid;
+		} else {
+			myers(c, xmid, xlim, ymid, ylim);
+			xlim = xmid, ylim = ymid;
+		}
+	}
+}
+
+/**
+ * Longest increasing run of b positions among the anchors, by patience
+ * sorting
+ * @param  pos   b position of each anchor, in a order
+ * @param  k     [description]
+ * @param  keep  receives which anchors are on the run
+ */
+static void longest_increasing(const long *pos, size_t k, bool *keep) {
+	size_t *tops = malloc(k * sizeof(*tops)); // last anchor of each pile
+	size_t *prev = malloc(k * sizeof(*prev));
+	size_t piles = 0;
+
+	for (size_t i = 0; i < k; i++) {
+		size_t lo = 0, hi = piles;
+		while (lo < hi) {
+			size_t mid = (lo + hi) / 2;
+			if (pos[tops[mid]] < pos[i])
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		prev[i] = lo ? tops[lo - 1] : SIZE_MAX;
+		tops[lo] = i;
+		if (lo == piles)
+			piles++;
+	}
+
+	memset(keep, 0, k * sizeof(*keep));
+	for (size_t i = piles ? tops[piles - 1] : SIZE_MAX; i != SIZE_MAX; i = prev[i])
+		keep[i] = true;
+	free(tops);
+	free(prev);
+}
+
+static void patience(struct diff_context *c, long xoff, long xlim, long yoff, long ylim) {
+	const uint32_t *a = c->a, *b = c->b;
+
+	while (xoff < xlim && yoff < ylim && a[xoff] == b[yoff])
+		xoff++, yoff++;
+	while (xlim > xoff && ylim > yoff && a[xlim - 1] == b[ylim - 1])
+		xlim--, ylim--;
+	if (xoff == xlim || yoff == ylim) {
+		myers(c, xoff, xlim, yoff, ylim);
+		return;
+	}
+
+	for (long x = xoff; x < xlim; x++)
+		c->count_a[a[x]]++;
+	for (long y = yoff; y < ylim; y++) {
+		c->count_b[b[y]]++;
+		c->where_b[b[y]] = y;
+	}
+
+	size_t k = 0;
+	long *xs = malloc((xlim - xoff) * sizeof(*xs));
+	long *ys = malloc((xlim - xoff) * sizeof(*ys));
+	for (long x = xoff; x < xlim; x++) {
+		uint32_t id = a[x];
+		if (c->count_a[id] == 1 && c->count_b[id] == 1) {
+			xs[k] = x;
+			ys[k++] = c->where_b[id];
+		}
+	}
+
+	// the counts are shared by all levels, leave them zeroed
+	for (long x = xoff; x < xlim; x++)
+		c->count_a[a[x]] = 0;
+	for (long y = yoff; y < ylim; y++)
+		c->count_b[b[y]] = 0;
+
+	if (k == 0) {
+		free(xs);
+		free(ys);
+		myers(c, xoff, xlim, yoff, ylim);
+		return;
+	}
+
+	bool *keep = malloc(k * sizeof(*keep));
+	longest_increasing(ys, k, keep);
+
+	long x = xoff, y = yoff;
+	for (size_t i = 0; i < k; i++) {
+		if (!keep[i])
+			continue;
+		patience(c, x, xs[i], y, ys[i]);
+		x = xs[i] + 1;
+		y = ys[i] + 1;
+	}
+	patience(c, x, xlim, y, ylim);
+
+	free(keep);
+	free(xs);
+	free(ys);
+}
+
+void diff_sequences(const uint32_t *a, size_t n, const uint32_t *b, size_t m, size_t ids,
+					bool patience_diff, bool *changed_a, bool *changed_b) {
+	struct diff_context c = {a, b, changed_a, changed_b, NULL, NULL, 0, NULL, NULL, NULL};
+	size_t diagonals = n + m + 3;
+
+	memset(changed_a, 0, n * sizeof(*changed_a));
+	memset(changed_b, 0, m * sizeof(*changed_b));
+
+	c.fd = malloc(2 * diagonals * sizeof(long));
+	c.bd = c.fd + diagonals;
+	// diagonals run from -m - 1 to n + 1
+	c.fd += m + 1;
+	c.bd += m + 1;
+
+	// about the square root of the diagonals, but no less than 4096
+	c.too_expensive = 1;
+	for (size_t d = diagonals; d; d >>= 2)
+		c.too_expensive <<= 1;
+	if (c.too_expensive < 4096)
+		c.too_expensive = 4096;
+
+	if (patience_diff) {
+		c.count_a = calloc(ids + 1, sizeof(*c.count_a));
+		c.count_b = calloc(ids + 1, sizeof(*c.count_b));
+		c.where_b = malloc((ids + 1) * sizeof(*c.where_b));
+		patience(&c, 0, n, 0, m);
+		free(c.count_a);
+		free(c.count_b);
+		free(c.where_b);
+	} else {
+		myers(&c, 0, n, 0, m);
+	}
+
+	free(c.fd - (m + 1));
+}
@@ -0,0 +1,27 @@
+#ifndef DIFF_H
+#define DIFF_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Find a short edit script between two sequences, in linear space. Lines
+ * are compared as small integer ids, equal ids meaning equal lines.
+ * The default is Myers' O(ND) algorithm with the middle snake split, which
+ * gives up on optimality past a cost limit so huge, very different inputs
+ * still finish. The patience variant first anchors on lines that occur
+ * exactly once on both sides, which often reads better for moved blocks.
+ * @param a         [description]
+ * @param n         [description]
+ * @param b         [description]
+ * @param m         [description]
+ * @param ids       every id is below this
+ * @param patience  [description]
+ * @param changed_a receives, for each line of a, whether it was deleted
+ * @param changed_b receives, for each line of b, whether it was inserted
+ */
+void diff_sequences(const uint32_t *a, size_t n, const uint32_t *b, size_t m, size_t ids,
+					bool patience, bool *changed_a, bool *changed_b);
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Finalizer of MurmurHash3, spreads every input bit over the whole word
+ * @param  h [description]
+ * @return   [description]
+ */
+static inline uint64_t hash_mix(uint64_t h) {
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+/**
+ * Fast non-cryptographic 64-bit hash, consumes eight bytes per step.
+ * Good enough for hash tables and sketches, not for anything adversarial.
+ * @param  data [description]
+ * @param  len  [description]
+ * @param  seed selects an independent hash function
+ * @return      [description]
+ */
+static inline uint64_t hash_bytes_seed(const void *data, size_t len, uint64_t seed) {
+	const unsigned char *p = (const unsigned char *)data;
+	uint64_t h = seed ^ (len * 0x9e3779b97f4a7c15ULL);
+	uint64_t k;
+
+	while (len >= 8) {
+		memcpy(&k, p, 8);
+		h = (h ^ hash_mix(k)) * 0x100000001b3ULL;
+		h = (h << 31) | (h >> 33);
+		p += 8;
+		len -= 8;
+	}
+
+	k = 0;
+	memcpy(&k, p, len);
+	h ^= k;
+	return hash_mix(h);
+}
+
+static inline uint64_t hash_bytes(const void *data, size_t len) {
+	return hash_bytes_seed(data, len, 0);
+}
+
+#endif
@@ -0,0 +1,850 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "diff.h"
+#include "hdiff.h"
+#include "hash.h"
+#include "lines.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HDIFF_X86 1
+#endif
+
+// block size for inputs that cannot be mapped
+#define HDIFF_BLOCK (1024 * 1024)
+
+/**
+ * Compare a word at a time and only look at the bytes of differing words
+ */
+static uint64_t count_scalar(const unsigned char *a, const unsigned char *b, size_t n) {
+	uint64_t diff = 0;
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8) {
+		uint64_t x, y;
+		memcpy(&x, a + i, 8);
+		memcpy(&y, b + i, 8);
+		if (x == y)
+			continue;
+		for (int j = 0; j < 8; j++)
+			diff += a[i + j] != b[i + j];
+	}
+	for (; i < n; i++)
+		diff += a[i] != b[i];
+	return diff;
+}
+
+#ifdef HDIFF_X86
+__attribute__((target("sse2")))
+static uint64_t count_sse2(const unsigned char *a, const unsigned char *b, size_t n) {
+	uint64_t diff = 0;
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+		__m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+		unsigned equal = _mm_movemask_epi8(_mm_cmpeq_epi8(x, y));
+		if (equal != 0xffff)
+			diff += 16 - __builtin_popcount(equal);
+	}
+	return diff + count_scalar(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2,popcnt")))
+static uint64_t count_avx2(const unsigned char *a, const unsigned char *b, size_t n) {
+	uint64_t diff = 0;
+	size_t i = 0;
+
+	// 128 bytes per step, identical blocks cost one test
+	for (; i + 128 <= n; i += 128) {
+		__m256i d0 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(a + i)),
+									  _mm256_loadu_si256((const __m256i *)(b + i)));
+		__m256i d1 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(a + i + 32)),
+									  _mm256_loadu_si256((const __m256i *)(b + i + 32)));
+		__m256i d2 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(a + i + 64)),
+									  _mm256_loadu_si256((const __m256i *)(b + i + 64)));
+		__m256i d3 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(a + i + 96)),
+									  _mm256_loadu_si256((const __m256i *)(b + i + 96)));
+		__m256i any = _mm256_or_si256(_mm256_or_si256(d0, d1), _mm256_or_si256(d2, d3));
+		if (_mm256_testz_si256(any, any))
+			continue;
+
+		// only a differing block is counted byte by byte
+		const __m256i zero = _mm256_setzero_si256();
+		uint64_t equal =
+			(uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(d0, zero)) |
+			(uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(d1, zero)) << 32;
+		uint64_t equal2 =
+			(uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(d2, zero)) |
+			(uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(d3, zero)) << 32;
+		diff += 128 - __builtin_popcountll(equal) - __builtin_popcountll(equal2);
+	}
+	return diff + count_sse2(a + i, b + i, n - i);
+}
+#endif
+
+/**
+ * Length of the prefix where the bytes of a and b are equal, or differ
+ * @param  equal which of the two the prefix is made of
+ */
+static size_t span_scalar(const unsigned char *a, const unsigned char *b, size_t n, bool equal) {
+	size_t i = 0;
+
+	if (equal) {
+		for (; i + 8 <= n; i += 8) {
+			uint64_t x, y;
+			memcpy(&x, a + i, 8);
+			memcpy(&y, b + i, 8);
+			if (x != y)
+				break;
+		}
+	}
+	while (i < n && (a[i] == b[i]) == equal)
+		i++;
+	return i;
+}
+
+#ifdef HDIFF_X86
+__attribute__((target("avx2")))
+static size_t span_avx2(const unsigned char *a, const unsigned char *b, size_t n, bool equal) {
+	uint32_t flip = equal ? 0xffffffff : 0;
+	size_t i = 0;
+
+	for (; i + 32 <= n; i += 32) {
+		__m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+		__m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+		// bits set where the span ends
+		uint32_t stop = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)) ^ flip;
+		if (stop)
+			return i + __builtin_ctz(stop);
+	}
+	return i + span_scalar(a + i, b + i, n - i, equal);
+}
+#endif
+
+static uint64_t (*count_diff)(const unsigned char *, const unsigned char *, size_t);
+static size_t (*span)(const unsigned char *, const unsigned char *, size_t, bool);
+static pthread_once_t impl_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Pick the implementations for this CPU, once
+ */
+static void pick_impl(void) {
+	count_diff = count_scalar;
+	span = span_scalar;
+#ifdef HDIFF_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+		count_diff = count_avx2;
+		span = span_avx2;
+	} else if (__builtin_cpu_supports("sse2")) {
+		count_diff = count_sse2;
+	}
+#endif
+}
+
+uint64_t hdiff_count(const unsigned char *a, const unsigned char *b, size_t n) {
+	pthread_once(&impl_once, pick_impl);
+	return count_diff(a, b, n);
+}
+
+/**
+ * Fill a buffer unless the input ends first
+ * @return bytes read, -1 on errors
+ */
+static ssize_t read_full(int fd, unsigned char *buf, size_t size) {
+	size_t done = 0;
+	while (done < size) {
+		ssize_t n = read(fd, buf + done, size - done);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n == -1)
+			return -1;
+		if (n == 0)
+			break;
+		done += n;
+	}
+	return done;
+}
+
+/**
+ * Compare inputs that cannot be mapped, such as pipes, in big blocks
+ * @param  diff    receives the number of differing bytes
+ * @param  longer  set if one input went on after the other ended
+ * @return         0, or -1 with errno set
+ */
+static int compare_blocks(int fd1, int fd2, uint64_t *diff, bool *longer) {
+	unsigned char *buf1, *buf2;
+	int r = 0;
+
+	if (posix_memalign((void **)&buf1, 64, HDIFF_BLOCK) != 0)
+		return -1;
+	if (posix_memalign((void **)&buf2, 64, HDIFF_BLOCK) != 0) {
+		free(buf1);
+		return -1;
+	}
+
+	*diff = 0;
+	*longer = false;
+	while (1) {
+		ssize_t n1 = read_full(fd1, buf1, HDIFF_BLOCK);
+		ssize_t n2 = read_full(fd2, buf2, HDIFF_BLOCK);
+		if (n1 == -1 || n2 == -1) {
+			r = -1;
+			break;
+		}
+		*diff += count_diff(buf1, buf2, n1 < n2 ? n1 : n2);
+		if (n1 != n2) {
+			*longer = true;
+			break;
+		}
+		if (n1 < HDIFF_BLOCK)
+			break;
+	}
+
+	free(buf1);
+	free(buf2);
+	return r;
+}
+
+/**
+ * @return 0, 1 if the files differ in length, or -1 with errno set
+ */
+static int compare_fds(int fd1, int fd2, uint64_t *diff) {
+	struct stat st1, st2;
+	bool longer;
+
+	if (fstat(fd1, &st1) == -1 || fstat(fd2, &st2) == -1)
+		return -1;
+
+	*diff = 0;
+	if (S_ISREG(st1.st_mode) && S_ISREG(st2.st_mode)) {
+		if (st1.st_size != st2.st_size)
+			return 1;
+		// the same file, or nothing to compare
+		if ((st1.st_dev == st2.st_dev && st1.st_ino == st2.st_ino) || st1.st_size == 0)
+			return 0;
+
+		size_t size = st1.st_size;
+		void *map1 = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd1, 0);
+		void *map2 = map1 == MAP_FAILED ? MAP_FAILED :
+			mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd2, 0);
+		if (map2 != MAP_FAILED) {
+			madvise(map1, size, MADV_SEQUENTIAL);
+			madvise(map2, size, MADV_SEQUENTIAL);
+			*diff = count_diff(map1, map2, size);
+			munmap(map1, size);
+			munmap(map2, size);
+			return 0;
+		}
+		if (map1 != MAP_FAILED)
+			munmap(map1, size);
+	}
+
+	if (compare_blocks(fd1, fd2, diff, &longer) == -1)
+		return -1;
+	return longer;
+}
+
+int hdiff_binary(const char *path1, const char *path2, FILE *out) {
+	int fd1 = open(path1, O_RDONLY | O_CLOEXEC);
+	if (fd1 == -1)
+		return -1;
+	int fd2 = open(path2, O_RDONLY | O_CLOEXEC);
+	if (fd2 == -1) {
+		close(fd1);
+		return -1;
+	}
+
+	uint64_t diff;
+	pthread_once(&impl_once, pick_impl);
+	int r = compare_fds(fd1, fd2, &diff);
+	int saved = errno;
+	close(fd1);
+	close(fd2);
+	errno = saved;
+
+	if (r == 1)
+		fprintf(out, "Files differ in length.\n");
+	else if (r == 0 && diff == 0)
+		fprintf(out, "The two files are identical\n");
+	else if (r == 0)
+		fprintf(out, "The two files are different in %" PRIu64 " bytes\n", diff);
+	return r == -1 ? -1 : 0;
+}
+
+/*
+ * Range report for big files. Both files are mapped, the regions where
+ * either holds data are cut into segments aligned to HDIFF_SEGMENT, and
+ * worker threads take segments off a shared counter. Regions that are holes
+ * in both files read as zeros on both sides and are never touched.
+ */
+#define HDIFF_SEGMENT (8 << 20)
+
+struct extent {
+	off_t start, end;
+};
+
+struct segment {
+	off_t start, end;
+	struct extent *ranges; // differing bytes, in order
+	size_t count;
+};
+
+struct range_work {
+	const unsigned char *a, *b;
+	struct segment *segments;
+	size_t segment_count;
+	atomic_size_t next;
+};
+
+/**
+ * The data regions of a file, as SEEK_DATA and SEEK_HOLE see them
+ * @param  fd    [description]
+ * @param  size  [description]
+ * @param  count receives the number of extents
+ * @return       malloc'd extents, the whole file if holes are not reported
+ */
+static struct extent *data_extents(int fd, off_t size, size_t *count) {
+	struct extent *extents = NULL;
+	size_t n = 0, capacity = 0;
+	off_t pos = 0;
+
+	while (pos < size) {
+		off_t start = lseek(fd, pos, SEEK_DATA);
+		if (start == -1 && errno == ENXIO)
+			break; // only a hole is left
+		if (start == -1) {
+			// the file system does not know, treat it all as data
+			free(extents);
+			extents = malloc(sizeof(*extents));
+			extents[0] = (struct extent){0, size};
+			*count = 1;
+			return extents;
+		}
+		off_t end = lseek(fd, start, SEEK_HOLE);
+		if (end == -1 || end > size)
+			end = size;
+
+		if (n == capacity) {
+			capacity = capacity ? capacity * 2 : 16;
+			extents = realloc(extents, capacity * sizeof(*extents));
+		}
+		extents[n++] = (struct extent){start, end};
+		pos = end;
+	}
+	*count = n;
+	return extents;
+}
+
+/**
+ * Cut the union of two sorted extent lists, up to limit, into segments
+ */
+static struct segment *make_segments(const struct extent *x, size_t nx, const struct extent *y,
+									 size_t ny, off_t limit, size_t *count) {
+	struct segment *segments = NULL;
+	size_t n = 0, capacity = 0, i = 0, j = 0;
+
+	while (i < nx || j < ny) {
+		// the next extent of the union starts at whichever comes first
+		struct extent u = (j >= ny || (i < nx && x[i].start <= y[j].start)) ? x[i] : y[j];
+		while (1) {
+			if (i < nx && x[i].start <= u.end) {
+				if (x[i].end > u.end)
+					u.end = x[i].end;
+				i++;
+			} else if (j < ny && y[j].start <= u.end) {
+				if (y[j].end > u.end)
+					u.end = y[j].end;
+				j++;
+			} else {
+				break;
+			}
+		}
+		if (u.end > limit)
+			u.end = limit;
+
+		for (off_t start = u.start; start < u.end;) {
+			off_t end = (start / HDIFF_SEGMENT + 1) * HDIFF_SEGMENT;
+			if (end > u.end)
+				end = u.end;
+			if (n == capacity) {
+				capacity = capacity ? capacity * 2 : 64;
+				segments = realloc(segments, capacity * sizeof(*segments));
+			}
+			segments[n++] = (struct segment){start, end, NULL, 0};
+			start = end;
+		}
+	}
+	*count = n;
+	return segments;
+}
+
+static void add_range(struct extent **ranges, size_t *count, off_t start, off_t end) {
+	// merge with the previous range when they touch
+	if (*count && (*ranges)[*count - 1].end == start) {
+		(*ranges)[*count - 1].end = end;
+		return;
+	}
+	if ((*count & (*count - 1)) == 0)
+		*ranges = realloc(*ranges, (*count ? *count * 2 : 1) * sizeof(**ranges));
+	(*ranges)[(*count)++] = (struct extent){start, end};
+}
+
+static void *compare_segments(void *arg) {
+	struct range_work *w = arg;
+	size_t i;
+
+	while ((i = atomic_fetch_add(&w->next, 1)) < w->segment_count) {
+		struct segment *seg = &w->segments[i];
+		size_t pos = seg->start, end = seg->end;
+
+		while (pos < end) {
+			pos += span(w->a + pos, w->b + pos, end - pos, true);
+			if (pos == end)
+				break;
+			size_t run = span(w->a + pos, w->b + pos, end - pos, false);
+			add_range(&seg->ranges, &seg->count, pos, pos + run);
+			pos += run;
+		}
+	}
+	return NULL;
+}
+
+static int compare_ranges(int fd1, int fd2, int jobs, FILE *out) {
+	struct stat st1, st2;
+
+	if (fstat(fd1, &st1) == -1 || fstat(fd2, &st2) == -1)
+		return -1;
+	if (!S_ISREG(st1.st_mode) || !S_ISREG(st2.st_mode)) {
+		errno = EINVAL; // ranges need to seek and map
+		return -1;
+	}
+
+	off_t common = st1.st_size < st2.st_size ? st1.st_size : st2.st_size;
+	off_t longest = st1.st_size < st2.st_size ? st2.st_size : st1.st_size;
+	const unsigned char *a = NULL, *b = NULL;
+	if (common > 0) {
+		a = mmap(NULL, common, PROT_READ, MAP_PRIVATE, fd1, 0);
+		b = a == MAP_FAILED ? MAP_FAILED : mmap(NULL, common, PROT_READ, MAP_PRIVATE, fd2, 0);
+		if (b == MAP_FAILED) {
+			if (a != MAP_FAILED)
+				munmap((void *)a, common);
+			return -1;
+		}
+	}
+
+	size_t nx, ny;
+	struct extent *x = data_extents(fd1, common, &nx);
+	struct extent *y = data_extents(fd2, common, &ny);
+	struct range_work work = {a, b, NULL, 0, 0};
+	work.segments = make_segments(x, nx, y, ny, common, &work.segment_count);
+	free(x);
+	free(y);
+
+	if (jobs < 1)
+		jobs = 1;
+	if ((size_t)jobs > work.segment_count)
+		jobs = work.segment_count ? work.segment_count : 1;
+	pthread_t threads[jobs];
+	bool started[jobs];
+	for (int i = 1; i < jobs; i++)
+		started[i] = pthread_create(&threads[i], NULL, compare_segments, &work) == 0;
+	compare_segments(&work);
+	for (int i = 1; i < jobs; i++)
+		if (started[i])
+			pthread_join(threads[i], NULL);
+
+	// segments are in file order, only their ends can still touch
+	struct extent *ranges = NULL;
+	size_t count = 0;
+	for (size_t i = 0; i < work.segment_count; i++) {
+		for (size_t k = 0; k < work.segments[i].count; k++)
+			add_range(&ranges, &count, work.segments[i].ranges[k].start,
+					  work.segments[i].ranges[k].end);
+		free(work.segments[i].ranges);
+	}
+	if (longest > common)
+		add_range(&ranges, &count, common, longest);
+
+	if (count == 0)
+		fprintf(out, "The two files are identical\n");
+	for (size_t i = 0; i < count; i++)
+		fprintf(out, "%lld,%lld\n", (long long)ranges[i].start,
+				(long long)(ranges[i].end - ranges[i].start));
+
+	free(ranges);
+	free(work.segments);
+	if (common > 0) {
+		munmap((void *)a, common);
+		munmap((void *)b, common);
+	}
+	return 0;
+}
+
+int hdiff_ranges(const char *path1, const char *path2, int jobs, FILE *out) {
+	int fd1 = open(path1, O_RDONLY | O_CLOEXEC);
+	if (fd1 == -1)
+		return -1;
+	int fd2 = open(path2, O_RDONLY | O_CLOEXEC);
+	if (fd2 == -1) {
+		close(fd1);
+		return -1;
+	}
+
+	pthread_once(&impl_once, pick_impl);
+	int r = compare_ranges(fd1, fd2, jobs, out);
+	int saved = errno;
+	close(fd1);
+	close(fd2);
+	errno = saved;
+	return r;
+}
+
+// lines of context around each hunk
+#define HDIFF_CONTEXT 3
+
+/*
+ * The index of a file: one entry per line, hashed while the lines are
+ * split, so that lines are only compared byte by byte when their hashes
+ * already agree. With the ignore options the hash is taken over the line
+ * as normalized, and so is that comparison.
+ */
+struct text_line {
+	size_t offset;
+	size_t len;
+	uint64_t hash;
+};
+
+struct text_file {
+	const char *path;
+	char *data;
+	size_t size;
+	bool mapped;
+	bool incomplete; // the last line has no newline
+	struct text_line *lines;
+	size_t count;
+	uint32_t *ids;
+	bool *changed;
+};
+
+static inline bool is_blank(unsigned char c) {
+	return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static inline bool ignoring(const struct hdiff_text_options *opt) {
+	return opt->ignore_space_change || opt->ignore_all_space || opt->ignore_case;
+}
+
+/**
+ * Next character of a line as the ignore options see it
+ * @param  p   advanced past what was consumed
+ * @param  end [description]
+ * @param  opt [description]
+ * @return     the character, -1 at the end of the line
+ */
+static inline int next_char(const char **p, const char *end, const struct hdiff_text_options *opt) {
+	if (opt->ignore_all_space || opt->ignore_space_change) {
+		const char *q = *p;
+		while (q < end && is_blank(*q))
+			q++;
+		if (q != *p && q < end && !opt->ignore_all_space) {
+			*p = q;
+			return ' ';
+		}
+		*p = q;
+	}
+	if (*p == end)
+		return -1;
+	unsigned char c = *(*p)++;
+	return opt->ignore_case && c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+/**
+ * Hash a line, normalized first if any ignore option is set
+ * @param  scratch at least len bytes
+ */
+static uint64_t line_hash(const char *p, size_t len, const struct hdiff_text_options *opt,
+						  char *scratch) {
+	if (!ignoring(opt))
+		return hash_bytes(p, len);
+
+	const char *end = p + len;
+	size_t n = 0;
+	int c;
+	while ((c = next_char(&p, end, opt)) != -1)
+		scratch[n++] = c;
+	return hash_bytes(scratch, n);
+}
+
+static bool lines_equal(const char *p, size_t n, const char *q, size_t m,
+						const struct hdiff_text_options *opt) {
+	if (!ignoring(opt))
+		return n == m && memcmp(p, q, n) == 0;
+
+	const char *p_end = p + n, *q_end = q + m;
+	int c;
+	do {
+		c = next_char(&p, p_end, opt);
+		if (c != next_char(&q, q_end, opt))
+			return false;
+	} while (c != -1);
+	return true;
+}
+
+/**
+ * Map a file, or read it whole if it cannot be mapped, and index its lines
+ * @return 0, or -1 with errno set
+ */
+static int text_load(struct text_file *f, const char *path, const struct hdiff_text_options *opt) {
+	struct stat st;
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+	memset(f, 0, sizeof(*f));
+	f->path = path;
+	if (fd == -1)
+		return -1;
+	if (fstat(fd, &st) == -1)
+		goto fail;
+
+	if (S_ISREG(st.st_mode) && st.st_size > 0) {
+		void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map != MAP_FAILED) {
+			f->data = map;
+			f->size = st.st_size;
+			f->mapped = true;
+		}
+	}
+	if (!f->mapped) {
+		size_t capacity = HDIFF_BLOCK;
+		f->data = malloc(capacity);
+		while (1) {
+			ssize_t n = read_full(fd, (unsigned char *)f->data + f->size, capacity - f->size);
+			if (n == -1)
+				goto fail;
+			f->size += n;
+			if (f->size < capacity)
+				break;
+			capacity *= 2;
+			f->data = realloc(f->data, capacity);
+		}
+	}
+	close(fd);
+
+	// the line is still in cache from the newline search when it is hashed
+	size_t capacity = 1024, scratch_size = 0;
+	const char *p = f->data, *end = f->data + f->size;
+	char *scratch = NULL;
+	f->lines = malloc(capacity * sizeof(*f->lines));
+	while (p < end) {
+		const char *nl = lines_find_newline(p, end - p);
+		size_t len = (nl ? nl : end) - p;
+		if (f->count == capacity) {
+			capacity *= 2;
+			f->lines = realloc(f->lines, capacity * sizeof(*f->lines));
+		}
+		if (ignoring(opt) && len > scratch_size) {
+			scratch_size = len * 2;
+			scratch = realloc(scratch, scratch_size);
+		}
+		f->lines[f->count++] = (struct text_line){p - f->data, len, line_hash(p, len, opt, scratch)};
+		p = nl ? nl + 1 : end;
+	}
+	free(scratch);
+	f->incomplete = f->size && f->data[f->size - 1] != '\n';
+	f->ids = malloc((f->count + 1) * sizeof(*f->ids));
+	f->changed = malloc(f->count + 1);
+	return 0;
+
+fail:;
+	int saved = errno;
+	if (!f->mapped)
+		free(f->data);
+	f->data = NULL;
+	close(fd);
+	errno = saved;
+	return -1;
+}
+
+static void text_free(struct text_file *f) {
+	if (f->mapped)
+		munmap(f->data, f->size);
+	else
+		free(f->data);
+	free(f->lines);
+	free(f->ids);
+	free(f->changed);
+}
+
+static void print_line(const struct text_file *f, size_t i, char prefix, FILE *out) {
+	fputc(prefix, out);
+	fwrite(f->data + f->lines[i].offset, 1, f->lines[i].len, out);
+	fputc('\n', out);
+	if (f->incomplete && i == f->count - 1)
+		fputs("\\ No newline at end of file\n", out);
+}
+
+struct change {
+	size_t a0, a1, b0, b1; // deleted a[a0, a1), inserted b[b0, b1)
+};
+
+/**
+ * Hunk header range, unified style: an empty range names the line before
+ */
+static void print_range(size_t start, size_t len, FILE *out) {
+	if (len == 1)
+		fprintf(out, "%zu", start + 1);
+	else
+		fprintf(out, "%zu,%zu", len ? start + 1 : start, len);
+}
+
+static void print_hunks(const struct text_file *a, const struct text_file *b, FILE *out) {
+	struct change *changes = NULL;
+	size_t count = 0, capacity = 0;
+
+	// collect runs of changed lines
+	for (size_t i = 0, j = 0; i < a->count || j < b->count;) {
+		if ((i < a->count && a->changed[i]) || (j < b->count && b->changed[j])) {
+			struct change c = {i, i, j, j};
+			while (c.a1 < a->count && a->changed[c.a1])
+				c.a1++;
+			while (c.b1 < b->count && b->changed[c.b1])
+				c.b1++;
+			if (count == capacity) {
+				capacity = capacity ? capacity * 2 : 64;
+				changes = realloc(changes, capacity * sizeof(*changes));
+			}
+			changes[count++] = c;
+			i = c.a1;
+			j = c.b1;
+		} else {
+			i++, j++;
+		}
+	}
+
+	fprintf(out, "--- %s\n+++ %s\n", a->path, b->path);
+	for (size_t first = 0; first < count;) {
+		// changes closer than twice the context share a hunk
+		size_t last = first;
+		while (last + 1 < count && changes[last + 1].a0 - changes[last].a1 <= 2 * HDIFF_CONTEXT)
+			last++;
+
+		size_t before = changes[first].a0 < HDIFF_CONTEXT ? changes[first].a0 : HDIFF_CONTEXT;
+		size_t a0 = changes[first].a0 - before, b0 = changes[first].b0 - before;
+		size_t after = a->count - changes[last].a1;
+		if (after > HDIFF_CONTEXT)
+			after = HDIFF_CONTEXT;
+		size_t a1 = changes[last].a1 + after, b1 = changes[last].b1 + after;
+
+		fputs("@@ -", out);
+		print_range(a0, a1 - a0, out);
+		fputs(" +", out);
+		print_range(b0, b1 - b0, out);
+		fputs(" @@\n", out);
+
+		size_t i = a0, j = b0;
+		for (size_t k = first; k <= last; k++) {
+			for (; i < changes[k].a0; i++, j++)
+				print_line(a, i, ' ', out);
+			for (; i < changes[k].a1; i++)
+				print_line(a, i, '-', out);
+			for (; j < changes[k].b1; j++)
+				print_line(b, j, '+', out);
+		}
+		for (; i < a1; i++, j++)
+			print_line(a, i, ' ', out);
+		first = last + 1;
+	}
+	free(changes);
+}
+
+struct id_slot {
+	uint64_t hash;
+	const char *p; // first line seen with this id
+	size_t len;
+	uint32_t id; // + 1, 0 for empty slots
+};
+
+/**
+ * Number the distinct lines of both files. A slot is only compared byte by
+ * byte once the hashes agree, which for a line that is new to the table
+ * almost never happens.
+ * @return the number of ids, the incomplete last lines get theirs above it
+ */
+static size_t assign_ids(struct text_file *a, struct text_file *b,
+						 const struct hdiff_text_options *opt) {
+	size_t capacity = 1024;
+	while (capacity < 2 * (a->count + b->count))
+		capacity *= 2;
+	struct id_slot *slots = calloc(capacity, sizeof(*slots));
+	uint32_t ids = 0;
+
+	struct text_file *files[2] = {a, b};
+	for (int k = 0; k < 2; k++) {
+		struct text_file *f = files[k];
+		for (size_t i = 0; i < f->count; i++) {
+			const struct text_line *l = &f->lines[i];
+			const char *p = f->data + l->offset;
+			size_t slot = l->hash & (capacity - 1);
+			while (slots[slot].id && (slots[slot].hash != l->hash ||
+									  !lines_equal(slots[slot].p, slots[slot].len, p, l->len, opt)))
+				slot = (slot + 1) & (capacity - 1);
+			if (!slots[slot].id)
+				slots[slot] = (struct id_slot){l->hash, p, l->len, ++ids};
+			f->ids[i] = slots[slot].id - 1;
+		}
+	}
+	free(slots);
+
+	// a last line without a newline only equals another one without
+	if (a->incomplete)
+		a->ids[a->count - 1] += ids;
+	if (b->incomplete)
+		b->ids[b->count - 1] += ids;
+	return ids;
+}
+
+int hdiff_text(const char *path1, const char *path2, const struct hdiff_text_options *opt,
+			   FILE *out) {
+	struct text_file a, b;
+
+	if (text_load(&a, path1, opt) == -1)
+		return -1;
+	if (text_load(&b, path2, opt) == -1) {
+		int saved = errno;
+		text_free(&a);
+		errno = saved;
+		return -1;
+	}
+
+	// equal lines get equal ids, so the diff compares integers only
+	size_t ids = assign_ids(&a, &b, opt);
+
+	diff_sequences(a.ids, a.count, b.ids, b.count, 2 * ids, opt->patience, a.changed, b.changed);
+
+	bool differ = false;
+	for (size_t i = 0; i < a.count && !differ; i++)
+		differ = a.changed[i];
+	for (size_t i = 0; i < b.count && !differ; i++)
+		differ = b.changed[i];
+
+	if (differ)
+		print_hunks(&a, &b, out);
+	else
+		fprintf(out, "The two text files are identical\n");
+
+	text_free(&a);
+	text_free(&b);
+	return 0;
+}
@@ -0,0 +1,94 @@
+#ifndef HDIFF_H
+#define HDIFF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// most worker threads any -j gets, larger values are clamped to it
+#define HDIFF_MAX_JOBS 64
+
+/**
+ * Count the bytes that differ at the same offsets of two files of the same
+ * size, and print the result. Files of different sizes are reported as
+ * such from fstat alone, without reading them.
+ * @param  path1 [description]
+ * @param  path2 [description]
+ * @param  out   [description]
+ * @return       0, or -1 with errno set
+ */
+int hdiff_binary(const char *path1, const char *path2, FILE *out);
+
+/**
+ * Print the byte ranges in which two files differ, one offset,length pair
+ * per line. Bytes past the end of the shorter file count as differing.
+ * Holes of sparse files are skipped, not read.
+ * @param  path1 [description]
+ * @param  path2 [description]
+ * @param  jobs  worker threads
+ * @param  out   [description]
+ * @return       0, or -1 with errno set
+ */
+int hdiff_ranges(const char *path1, const char *path2, int jobs, FILE *out);
+
+/**
+ * Compare two directory trees. Files that differ in size, or match in
+ * size and mtime, are settled without reading them, the rest is hashed on
+ * worker threads and diffed only where the hashes disagree.
+ * @param  dir1 [description]
+ * @param  dir2 [description]
+ * @param  jobs worker threads, at most HDIFF_MAX_JOBS
+ * @param  out  [description]
+ * @return      0, or -1 with errno set
+ */
+int hdiff_tree(const char *dir1, const char *dir2, int jobs, FILE *out);
+
+/**
+ * Write a patch that turns one file into another. Matching is done with
+ * a rolling checksum over blocks of the old file, so data that moved or
+ * had bytes inserted before it still matches.
+ * @param  old_path [description]
+ * @param  new_path [description]
+ * @param  out      receives the binary patch
+ * @return          0, or -1 with errno set
+ */
+int hdiff_delta(const char *old_path, const char *new_path, FILE *out);
+
+/**
+ * Rebuild the new file from the old one and a patch of hdiff_delta
+ * @param  old_path   [description]
+ * @param  patch_path [description]
+ * @param  out        receives the new file
+ * @return            0, or -1 with errno set, EINVAL if the patch is
+ *                    corrupt or was made against another old file
+ */
+int hdiff_apply(const char *old_path, const char *patch_path, FILE *out);
+
+struct hdiff_text_options {
+	bool patience;            // anchor on unique lines first, see diff.h
+	bool ignore_space_change; // runs of blanks compare as one, trailing ones not at all
+	bool ignore_all_space;    // blanks do not compare at all
+	bool ignore_case;
+};
+
+/**
+ * Print a unified diff of two text files, or that they are identical
+ * @param  path1 [description]
+ * @param  path2 [description]
+ * @param  opt   [description]
+ * @param  out   [description]
+ * @return       0, or -1 with errno set
+ */
+int hdiff_text(const char *path1, const char *path2, const struct hdiff_text_options *opt,
+			   FILE *out);
+
+/**
+ * Number of differing bytes between two buffers, vectorized
+ * @param  a [description]
+ * @param  b [description]
+ * @param  n [description]
+ * @return   [description]
+ */
+uint64_t hdiff_count(const unsigned char *a, const unsigned char *b, size_t n);
+
+#endif
@@ -0,0 +1,382 @@
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "hash.h"
+#include "hdiff.h"
+
+/*
+ * Recursive comparison of two trees. Both are walked in name order with
+ * getdents64, and most pairs of regular files are settled by fstatat
+ * alone: a size mismatch means they differ, equal size and mtime means
+ * they are taken as equal, the way rsync's quick check does. Only the
+ * rest is read, hashed on a pool of threads, and diffed byte by byte
+ * where the hashes disagree. Output is printed in walk order at the end.
+ */
+
+struct linux_dirent64 {
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+struct dir_entry {
+	char *name;
+	unsigned char type; // DT_*
+};
+
+enum item_kind {
+	ONLY_IN_A,
+	ONLY_IN_B,
+	TYPE_DIFFERS,
+	SIZE_DIFFERS,
+	LINK_DIFFERS,
+	CONTENT,  // needs hashing
+};
+
+struct item {
+	enum item_kind kind;
+	char *path; // relative to both roots
+	// CONTENT results, filled in by the workers
+	int error;  // errno, 0 if compared
+	bool differ;
+	uint64_t diff_bytes;
+};
+
+struct tree_walk {
+	const char *root_a, *root_b;
+	struct item *items;
+	size_t count, capacity;
+	size_t files, quick_same;
+	atomic_size_t next; // next item for the workers
+};
+
+static int by_name(const void *a, const void *b) {
+	return strcmp(((const struct dir_entry *)a)->name, ((const struct dir_entry *)b)->name);
+}
+
+/**
+ * Read a directory with getdents64, skipping . and ..
+ * @param  fd    directory, closed here
+ * @param  count receives the number of entries
+ * @return       malloc'd entries sorted by name, NULL with errno set on errors
+ */
+static struct dir_entry *read_dir(int fd, size_t *count) {
+	char buf[64 * 1024] __attribute__((aligned(8)));
+	struct dir_entry *entries = NULL;
+	size_t n = 0, capacity = 0;
+	long got;
+
+	while ((got = syscall(SYS_getdents64, fd, buf, sizeof(buf))) > 0) {
+		for (long pos = 0; pos < got;) {
+			struct linux_dirent64 *d = (struct linux_dirent64 *)(buf + pos);
+			pos += d->d_reclen;
+			if (strcmp(d->d_name, ".") == 0 || strcmp(d->d_name, "..") == 0)
+				continue;
+
+			unsigned char type = d->d_type;
+			if (type == DT_UNKNOWN) {
+				// not every file system fills d_type in
+				struct stat st;
+				if (fstatat(fd, d->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0)
+					type = IFTODT(st.st_mode);
+			}
+			if (n == capacity) {
+				capacity = capacity ? capacity * 2 : 64;
+				entries = realloc(entries, capacity * sizeof(*entries));
+			}
+			entries[n].name = strdup(d->d_name);
+			entries[n++].type = type;
+		}
+	}
+	int saved = errno;
+	close(fd);
+	if (got == -1) {
+		while (n--)
+			free(entries[n].name);
+		free(entries);
+		errno = saved;
+		return NULL;
+	}
+
+	if (n)
+		qsort(entries, n, sizeof(*entries), by_name);
+	*count = n;
+	return entries ? entries : calloc(1, sizeof(*entries));
+}
+
+static void add_item(struct tree_walk *w, enum item_kind kind, char *path) {
+	if (w->count == w->capacity) {
+		w->capacity = w->capacity ? w->capacity * 2 : 256;
+		w->items = realloc(w->items, w->capacity * sizeof(*w->items));
+	}
+	w->items[w->count++] = (struct item){kind, path, 0, false, 0};
+}
+
+static char *join(const char *dir, const char *name) {
+	size_t len = strlen(dir);
+	char *path = malloc(len + strlen(name) + 2);
+	memcpy(path, dir, len);
+	path[len] = '/';
+	strcpy(path + len + 1, name);
+	return path;
+}
+
+static bool same_target(int dir_a, int dir_b, const char *name) {
+	char a[4096], b[4096];
+	ssize_t na = readlinkat(dir_a, name, a, sizeof(a));
+	ssize_t nb = readlinkat(dir_b, name, b, sizeof(b));
+	return na == nb && na >= 0 && memcmp(a, b, na) == 0;
+}
+
+/**
+ * Settle a pair of regular files from their metadata if possible
+ */
+static void compare_files(struct tree_walk *w, int dir_a, int dir_b, const char *name, char *path) {
+	struct stat a, b;
+
+	w->files++;
+	if (fstatat(dir_a, name, &a, 0) == -1 || fstatat(dir_b, name, &b, 0) == -1) {
+		add_item(w, CONTENT, path); // let the worker report the error
+		return;
+	}
+	if (a.st_size != b.st_size) {
+		add_item(w, SIZE_DIFFERS, path);
+		return;
+	}
+	if (a.st_mtim.tv_sec == b.st_mtim.tv_sec && a.st_mtim.tv_nsec == b.st_mtim.tv_nsec) {
+		w->quick_same++;
+		free(path);
+		return;
+	}
+	add_item(w, CONTENT, path);
+}
+
+/**
+ * Compare the directories at rel under both roots
+ * @param  w   [description]
+ * @param  rel relative path, "." for the roots
+ * @return     0, or -1 with errno set
+ */
+static int walk(struct tree_walk *w, const char *rel) {
+	char *dir_path_a = join(w->root_a, rel), *dir_path_b = join(w->root_b, rel);
+	int dir_a = open(dir_path_a, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	int dir_b = open(dir_path_b, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	free(dir_path_a);
+	free(dir_path_b);
+	if (dir_a == -1 || dir_b == -1) {
+		int saved = errno;
+		if (dir_a != -1)
+			close(dir_a);
+		if (dir_b != -1)
+			close(dir_b);
+		errno = saved;
+		return -1;
+	}
+
+	size_t na = 0, nb = 0;
+	struct dir_entry *a = read_dir(dup(dir_a), &na);
+	struct dir_entry *b = a ? read_dir(dup(dir_b), &nb) : NULL;
+	int r = a && b ? 0 : -1;
+
+	for (size_t i = 0, j = 0; r == 0 && (i < na || j < nb);) {
+		int cmp = i == na ? 1 : j == nb ? -1 : strcmp(a[i].name, b[j].name);
+		const char *name = cmp <= 0 ? a[i].name : b[j].name;
+		// paths below the roots, without the leading "./"
+		char *path = strcmp(rel, ".") == 0 ? strdup(name) : join(rel, name);
+
+		if (cmp < 0) {
+			add_item(w, ONLY_IN_A, path);
+			i++;
+			continue;
+		}
+		if (cmp > 0) {
+			add_item(w, ONLY_IN_B, path);
+			j++;
+			continue;
+		}
+
+		unsigned char type = a[i].type;
+		if (type != b[j].type)
+			add_item(w, TYPE_DIFFERS, path);
+		else if (type == DT_DIR) {
+			r = walk(w, path);
+			free(path);
+		} else if (type == DT_REG)
+			compare_files(w, dir_a, dir_b, name, path);
+		else if (type == DT_LNK && !same_target(dir_a, dir_b, name))
+			add_item(w, LINK_DIFFERS, path);
+		else
+			free(path); // equal links, devices, fifos, sockets
+		i++, j++;
+	}
+
+	for (size_t i = 0; i < na; i++)
+		free(a[i].name);
+	for (size_t j = 0; j < nb; j++)
+		free(b[j].name);
+	free(a);
+	free(b);
+	close(dir_a);
+	close(dir_b);
+	return r;
+}
+
+struct mapped {
+	int fd;
+	const unsigned char *data;
+	size_t size;
+};
+
+static int map_file(const char *root, const char *rel, struct mapped *m) {
+	char *path = join(root, rel);
+	struct stat st;
+
+	m->fd = open(path, O_RDONLY | O_CLOEXEC);
+	free(path);
+	m->data = NULL;
+	m->size = 0;
+	if (m->fd == -1)
+		return -1;
+	if (fstat(m->fd, &st) == -1)
+		return -1;
+	m->size = st.st_size;
+	if (m->size) {
+		void *map = mmap(NULL, m->size, PROT_READ, MAP_PRIVATE, m->fd, 0);
+		if (map == MAP_FAILED)
+			return -1;
+		madvise(map, m->size, MADV_SEQUENTIAL);
+		m->data = map;
+	}
+	return 0;
+}
+
+static void unmap_file(struct mapped *m) {
+	if (m->data)
+		munmap((void *)m->data, m->size);
+	if (m->fd != -1)
+		close(m->fd);
+}
+
+static void compare_contents(struct tree_walk *w, struct item *it) {
+	struct mapped a, b = {-1, NULL, 0};
+
+	if (map_file(w->root_a, it->path, &a) == -1 || map_file(w->root_b, it->path, &b) == -1) {
+		it->error = errno;
+	} else if (a.size != b.size) {
+		// changed since the walk
+		it->differ = true;
+		it->diff_bytes = a.size > b.size ? a.size - b.size : b.size - a.size;
+	} else if (hash_bytes(a.data, a.size) != hash_bytes(b.data, b.size)) {
+		it->differ = true;
+		it->diff_bytes = hdiff_count(a.data, b.data, a.size);
+	}
+	// equal hashes are taken as equal contents, a 64-bit collision is
+	// far less likely than a disk error
+	unmap_file(&a);
+	unmap_file(&b);
+}
+
+static void *hash_worker(void *arg) {
+	struct tree_walk *w = arg;
+	size_t i;
+
+	while ((i = atomic_fetch_add(&w->next, 1)) < w->count)
+		if (w->items[i].kind == CONTENT)
+			compare_contents(w, &w->items[i]);
+	return NULL;
+}
+
+int hdiff_tree(const char *dir1, const char *dir2, int jobs, FILE *out) {
+	struct tree_walk w = {0};
+	w.root_a = dir1;
+	w.root_b = dir2;
+
+	if (walk(&w, ".") == -1) {
+		int saved = errno;
+		for (size_t i = 0; i < w.count; i++)
+			free(w.items[i].path);
+		free(w.items);
+		errno = saved;
+		return -1;
+	}
+
+	hdiff_count(NULL, NULL, 0); // pick the compare routine before the threads
+	size_t pending = 0;
+	for (size_t i = 0; i < w.count; i++)
+		pending += w.items[i].kind == CONTENT;
+	if (jobs > HDIFF_MAX_JOBS)
+		jobs = HDIFF_MAX_JOBS;
+	if ((size_t)jobs > pending)
+		jobs = pending;
+	if (jobs < 1)
+		jobs = 1;
+
+	// without room for the threads, this thread does all the work
+	pthread_t *threads = malloc(jobs * sizeof(*threads));
+	int started = 0;
+	while (threads && started + 1 < jobs &&
+		   pthread_create(&threads[started], NULL, hash_worker, &w) == 0)
+		started++;
+	hash_worker(&w);
+	for (int i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+
+	size_t hashed = 0, differ = 0;
+	for (size_t i = 0; i < w.count; i++) {
+		struct item *it = &w.items[i];
+		switch (it->kind) {
+		case ONLY_IN_A:
+			fprintf(out, "Only in %s: %s\n", dir1, it->path);
+			differ++;
+			break;
+		case ONLY_IN_B:
+			fprintf(out, "Only in %s: %s\n", dir2, it->path);
+			differ++;
+			break;
+		case TYPE_DIFFERS:
+			fprintf(out, "%s/%s and %s/%s are of different types\n", dir1, it->path, dir2, it->path);
+			differ++;
+			break;
+		case SIZE_DIFFERS:
+			fprintf(out, "Files %s/%s and %s/%s differ in length\n", dir1, it->path, dir2, it->path);
+			differ++;
+			break;
+		case LINK_DIFFERS:
+			fprintf(out, "Symbolic links %s/%s and %s/%s differ\n", dir1, it->path, dir2, it->path);
+			differ++;
+			break;
+		case CONTENT:
+			hashed++;
+			if (it->error) {
+				fprintf(out, "%s: %s\n", it->path, strerror(it->error));
+				differ++;
+			} else if (it->differ) {
+				fprintf(out, "Files %s/%s and %s/%s differ in %" PRIu64 " bytes\n",
+						dir1, it->path, dir2, it->path, it->diff_bytes);
+				differ++;
+			}
+			break;
+		}
+		free(it->path);
+	}
+	fprintf(out, "%zu files compared, %zu equal by size and mtime, %zu hashed, %zu differences\n",
+			w.files, w.quick_same, hashed, differ);
+
+	free(w.items);
+	return 0;
+}
@@ -0,0 +1,289 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "history.h"
+
+struct hist_entry {
+	const char *line; // into the mapping, or malloc'd when owned
+	uint32_t len;
+	bool owned;
+};
+
+// ring buffer, head is where the next entry goes
+static struct hist_entry *ring;
+static int head, count;
+// entries ever pushed, the newest has id total - 1
+static uint32_t total;
+
+static int append_fd = -1;
+
+/*
+ * Inverted index for Ctrl+R: each trigram, hashed to one of
+ * TRIGRAM_BUCKETS, lists the ids of the entries holding it in ascending
+ * order. A search only looks at the entries of the query's rarest
+ * trigram, newest first. A hash collision merely adds candidates, which
+ * memmem then rejects. The index is built on the first search, so
+ * start-up never reads the whole history, and kept up to date by
+ * history_add. Ids of entries that left the ring are trimmed lazily.
+ */
+#define TRIGRAM_BITS 16
+#define TRIGRAM_BUCKETS (1 << TRIGRAM_BITS)
+
+struct posting_list {
+	uint32_t *ids;
+	uint32_t len, capacity;
+};
+
+static struct posting_list *postings; // NULL until the first search
+static bool index_failed; // out of memory once, searches scan instead
+
+static inline unsigned trigram(const char *p) {
+	uint32_t t = (unsigned char)p[0] | (unsigned char)p[1] << 8 | (unsigned char)p[2] << 16;
+	return (t * 2654435761u) >> (32 - TRIGRAM_BITS);
+}
+
+static struct hist_entry *entry(int n) {
+	return &ring[(head - 1 - n + 2 * HISTORY_SIZE) % HISTORY_SIZE];
+}
+
+/**
+ * Add an entry to the posting lists of its trigrams
+ * @return false if a list could not grow
+ */
+static bool index_entry(const struct hist_entry *e, uint32_t id) {
+	for (size_t i = 0; i + 3 <= e->len; i++) {
+		struct posting_list *l = &postings[trigram(e->line + i)];
+		// ids only grow, so a repeat within this entry is the last id
+		if (l->len && l->ids[l->len - 1] == id)
+			continue;
+		if (l->len == l->capacity) {
+			uint32_t capacity = l->capacity ? l->capacity * 2 : 4;
+			uint32_t *ids = realloc(l->ids, capacity * sizeof(*ids));
+			if (!ids)
+				return false;
+			l->ids = ids;
+			l->capacity = capacity;
+		}
+		l->ids[l->len++] = id;
+	}
+	return true;
+}
+
+static void index_free(void) {
+	if (postings)
+		for (int i = 0; i < TRIGRAM_BUCKETS; i++)
+			free(postings[i].ids);
+	free(postings);
+	postings = NULL;
+}
+
+/**
+ * Index every entry in the ring, oldest first
+ * @return false if out of memory, the index is then gone for good
+ */
+static bool index_build(void) {
+	postings = calloc(TRIGRAM_BUCKETS, sizeof(*postings));
+	for (int n = count - 1; postings && n >= 0; n--) {
+		if (!index_entry(entry(n), total - 1 - n)) {
+			index_free();
+			break;
+		}
+	}
+	index_failed = !postings;
+	return postings != NULL;
+}
+
+static void push(const char *line, size_t len, bool owned) {
+	struct hist_entry *e = &ring[head];
+
+	if (count == HISTORY_SIZE && e->owned)
+		free((char *)e->line);
+	e->line = line;
+	e->len = len;
+	e->owned = owned;
+
+	head = (head + 1) % HISTORY_SIZE;
+	if (count < HISTORY_SIZE)
+		count++;
+	if (postings && !index_entry(e, total)) {
+		index_free();
+		index_failed = true;
+	}
+	total++;
+}
+
+void history_init(const char *path) {
+	char default_path[4096];
+	struct stat st;
+
+	ring = calloc(HISTORY_SIZE, sizeof(*ring));
+
+	if (!path)
+		path = getenv("HISTFILE");
+	if (!path) {
+		const char *home = getenv("HOME");
+		if (!home)
+			return;
+		snprintf(default_path, sizeof(default_path), "%s/.mishell_history", home);
+		path = default_path;
+	}
+
+	append_fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return;
+	if (fstat(fd, &st) == -1 || st.st_size == 0) {
+		close(fd);
+		return;
+	}
+
+	// the mapping stays for the life of the shell, entries point into it
+	size_t size = st.st_size;
+	const char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return;
+
+	// a line another shell is still writing has no newline yet
+	const char *end = memrchr(data, '\n', size);
+	if (!end)
+		return;
+
+	// walk back from the end, so only the tail of the file is touched
+	int n = 0;
+	const char *stop = end;
+	while (n < HISTORY_SIZE && stop > data) {
+		const char *nl = memrchr(data, '\n', stop - data);
+		const char *start = nl ? nl + 1 : data;
+		if (stop > start) {
+			struct hist_entry *e = &ring[HISTORY_SIZE - 1 - n++];
+			e->line = start;
+			e->len = stop - start;
+		}
+		if (!nl)
+			break;
+		stop = nl;
+	}
+
+	// move them to the front of the ring, oldest first
+	memmove(ring, ring + HISTORY_SIZE - n, sizeof(*ring) * n);
+	memset(ring + n, 0, sizeof(*ring) * (HISTORY_SIZE - n));
+	count = n;
+	total = n;
+	head = n % HISTORY_SIZE;
+}
+
+void history_add(const char *line) {
+	size_t len = strlen(line);
+
+	if (!ring || len == 0)
+		return;
+	if (count > 0) {
+		struct hist_entry *last = entry(0);
+		if (last->len == len && memcmp(last->line, line, len) == 0)
+			return;
+	}
+
+	push(strndup(line, len), len, true);
+
+	if (append_fd >= 0) {
+		struct iovec iov[2] = {
+			{(void *)line, len},
+			{"\n", 1},
+		};
+		flock(append_fd, LOCK_EX);
+		if (writev(append_fd, iov, 2) == -1) {
+			close(append_fd);
+			append_fd = -1;
+			return;
+		}
+		flock(append_fd, LOCK_UN);
+	}
+}
+
+int history_count(void) {
+	return count;
+}
+
+const char *history_get(int n, size_t *len) {
+	if (n < 0 || n >= count)
+		return NULL;
+	struct hist_entry *e = entry(n);
+	*len = e->len;
+	return e->line;
+}
+
+/**
+ * Every entry at or before the start-th, for queries the index cannot
+ * narrow down
+ */
+static int scan(const char *query, size_t qlen, int start) {
+	for (int n = start; n < count; n++) {
+		struct hist_entry *e = entry(n);
+		if (e->len >= qlen && memmem(e->line, e->len, query, qlen))
+			return n;
+	}
+	return -1;
+}
+
+int history_search(const char *query, size_t qlen, int start) {
+	if (start < 0)
+		start = 0;
+	if (start >= count)
+		return -1;
+	if (qlen < 3 || index_failed || (!postings && !index_build()))
+		return scan(query, qlen, start);
+
+	// the rarest trigram of the query has the fewest candidates
+	struct posting_list *best = NULL;
+	for (size_t i = 0; i + 3 <= qlen; i++) {
+		struct posting_list *l = &postings[trigram(query + i)];
+		if (!best || l->len < best->len)
+			best = l;
+	}
+
+	// drop the ids of entries that left the ring
+	uint32_t oldest = total - count, stale = 0;
+	while (stale < best->len && best->ids[stale] < oldest)
+		stale++;
+	if (stale) {
+		best->len -= stale;
+		memmove(best->ids, best->ids + stale, best->len * sizeof(*best->ids));
+	}
+
+	// newest first, from the last id at or before the start-th entry
+	uint32_t last = total - 1 - start;
+	uint32_t lo = 0, hi = best->len;
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (best->ids[mid] <= last)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	while (lo-- > 0) {
+		int n = total - 1 - best->ids[lo];
+		struct hist_entry *e = entry(n);
+		if (e->len >= qlen && memmem(e->line, e->len, query, qlen))
+			return n;
+	}
+	return -1;
+}
+
+void history_list(FILE *out, int n) {
+	if (n <= 0 || n > count)
+		n = count;
+	for (int i = n - 1; i >= 0; i--) {
+		struct hist_entry *e = entry(i);
+		fprintf(out, "%5d  %.*s\n", count - i, (int)e->len, e->line);
+	}
+}
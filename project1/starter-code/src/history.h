@@ -0,0 +1,62 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * Most entries kept in memory; older ones stay in the file only
+ */
+#define HISTORY_SIZE 100000
+
+/**
+ * Load the history file, by default ~/.mishell_history or $HISTFILE.
+ * The file is mmap'd and only its tail is indexed, so start-up cost does
+ * not depend on how large it has grown.
+ * @param path file to use, NULL for the default
+ */
+void history_init(const char *path);
+
+/**
+ * Remember a line and append it to the file. Appends from concurrent
+ * shells are serialized with flock and land whole thanks to O_APPEND.
+ * Empty lines and repeats of the last entry are skipped.
+ * @param line [description]
+ */
+void history_add(const char *line);
+
+/**
+ * Number of entries in memory
+ * @return [description]
+ */
+int history_count(void);
+
+/**
+ * An entry, counted back from the newest one
+ * @param  n   0 for the newest entry
+ * @param  len receives the length, entries are not NUL terminated
+ * @return     [description]
+ */
+const char *history_get(int n, size_t *len);
+
+/**
+ * Find the newest entry, at or before the n-th, that contains a string.
+ * Queries of three or more characters look only at the entries holding
+ * the query's rarest trigram, through an inverted index built on the
+ * first search and updated by history_add. It costs about four bytes per
+ * trigram of the history in memory. Shorter queries scan the entries.
+ * @param  query [description]
+ * @param  qlen  [description]
+ * @param  start n of the first entry to look at
+ * @return       n of the match, -1 if there is none
+ */
+int history_search(const char *query, size_t qlen, int start);
+
+/**
+ * Print the last entries, numbered
+ * @param out   [description]
+ * @param count how many, 0 for all
+ */
+void history_list(FILE *out, int count);
+
+#endif
@@ -0,0 +1,332 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include "jobs.h"
+
+// only changed with SIGCHLD blocked, so the handler always sees it whole
+static struct job **jobs;
+static int job_count, job_capacity;
+static struct job *current, *previous; // %+ and %-
+
+static bool job_control; // interactive, with a terminal to hand out
+static pid_t shell_pgid;
+static struct termios shell_tmodes;
+
+static void add_usage(struct rusage *sum, const struct rusage *ru) {
+	timeradd(&sum->ru_utime, &ru->ru_utime, &sum->ru_utime);
+	timeradd(&sum->ru_stime, &ru->ru_stime, &sum->ru_stime);
+}
+
+/**
+ * Reap every child that changed state and record it in its job.
+ * Only touches memory that already exists, nothing here allocates.
+ * @param sig [description]
+ */
+static void sigchld_handler(int sig) {
+	int saved_errno = errno;
+	struct rusage ru;
+	int status;
+	pid_t pid;
+
+	(void)sig;
+	while ((pid = wait4(-1, &status, WNOHANG | WUNTRACED | WCONTINUED, &ru)) > 0) {
+		for (int i = 0; i < job_count; i++) {
+			struct job *job = jobs[i];
+			for (int j = 0; j < job->proc_count; j++) {
+				struct job_proc *p = &job->procs[j];
+				if (p->pid != pid)
+					continue;
+
+				if (WIFSTOPPED(status)) {
+					p->state = JOB_STOPPED;
+					job->notified = false;
+				} else if (WIFCONTINUED(status)) {
+					p->state = JOB_RUNNING;
+				} else {
+					p->state = JOB_DONE;
+					p->status = status;
+					add_usage(&job->usage, &ru);
+					job->notified = false;
+				}
+				goto reaped;
+			}
+		}
+	reaped:;
+	}
+	errno = saved_errno;
+}
+
+void jobs_init(bool interactive) {
+	struct sigaction sa;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = sigchld_handler;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGCHLD, &sa, NULL);
+
+	if (!interactive)
+		return;
+
+	// wait until we are put in the foreground, if started in the background
+	while (tcgetpgrp(STDIN_FILENO) != (shell_pgid = getpgrp()))
+		kill(-shell_pgid, SIGTTIN);
+
+	// the shell hands the terminal to foreground jobs and takes it back
+	// afterwards; children get these signals back through launch_spawn
+	signal(SIGINT, SIG_IGN);
+	signal(SIGQUIT, SIG_IGN);
+	signal(SIGTSTP, SIG_IGN);
+	signal(SIGTTIN, SIG_IGN);
+	signal(SIGTTOU, SIG_IGN);
+
+	// fails harmlessly when the shell already leads its session
+	setpgid(0, 0);
+	shell_pgid = getpgrp();
+	tcsetpgrp(STDIN_FILENO, shell_pgid);
+	tcgetattr(STDIN_FILENO, &shell_tmodes);
+	job_control = true;
+}
+
+void jobs_block(sigset_t *orig) {
+	sigset_t set;
+	sigemptyset(&set);
+	sigaddset(&set, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &set, orig);
+}
+
+void jobs_unblock(const sigset_t *orig) {
+	sigprocmask(SIG_SETMASK, orig, NULL);
+}
+
+struct job *job_add(pid_t pgid, const pid_t *pids, int count, char *text) {
+	if (job_count == job_capacity) {
+		job_capacity = job_capacity ? job_capacity * 2 : 16;
+		jobs = realloc(jobs, sizeof(*jobs) * job_capacity);
+	}
+
+	struct job *job = calloc(1, sizeof(*job) + sizeof(struct job_proc) * count);
+	job->id = job_count ? jobs[job_count - 1]->id + 1 : 1;
+	job->pgid = pgid;
+	job->text = text;
+	job->notified = true;
+	job->proc_count = count;
+	for (int i = 0; i < count; i++) {
+		job->procs[i].pid = pids[i];
+		job->procs[i].state = JOB_RUNNING;
+	}
+
+	jobs[job_count++] = job;
+	previous = current;
+	current = job;
+	return job;
+}
+
+static void remove_job(struct job *job) {
+	int i = 0;
+	while (i < job_count && jobs[i] != job)
+		i++;
+	if (i == job_count)
+		return;
+
+	memmove(&jobs[i], &jobs[i + 1], sizeof(*jobs) * (job_count - i - 1));
+	job_count--;
+
+	if (current == job)
+		current = previous;
+	if (previous == job || previous == current)
+		previous = NULL;
+	if (!current && job_count)
+		current = jobs[job_count - 1];
+
+	free(job->text);
+	free(job);
+}
+
+struct job *job_find(const char *spec) {
+	if (!spec || !*spec || strcmp(spec, "%+") == 0 || strcmp(spec, "%%") == 0)
+		return current;
+	if (strcmp(spec, "%-") == 0)
+		return previous;
+
+	char *end;
+	long n = strtol(spec[0] == '%' ? spec + 1 : spec, &end, 10);
+	if (*end || n <= 0)
+		return NULL;
+
+	for (int i = 0; i < job_count; i++) {
+		if (spec[0] == '%') {
+			if (jobs[i]->id == n)
+				return jobs[i];
+			continue;
+		}
+		for (int j = 0; j < jobs[i]->proc_count; j++)
+			if (jobs[i]->procs[j].pid == n)
+				return jobs[i];
+	}
+	return NULL;
+}
+
+enum job_state job_state(struct job *job) {
+	bool stopped = false;
+
+	for (int i = 0; i < job->proc_count; i++) {
+		if (job->procs[i].state == JOB_RUNNING)
+			return JOB_RUNNING;
+		if (job->procs[i].state == JOB_STOPPED)
+			stopped = true;
+	}
+	return stopped ? JOB_STOPPED : JOB_DONE;
+}
+
+static int last_status(struct job *job) {
+	return job->procs[job->proc_count - 1].status;
+}
+
+static void continue_job(struct job *job) {
+	for (int i = 0; i < job->proc_count; i++)
+		if (job->procs[i].state == JOB_STOPPED)
+			job->procs[i].state = JOB_RUNNING;
+	kill(-job->pgid, SIGCONT);
+}
+
+int job_foreground(struct job *job, bool cont) {
+	sigset_t orig;
+	int status = -1;
+
+	jobs_block(&orig);
+	if (job_control)
+		tcsetpgrp(STDIN_FILENO, job->pgid);
+	if (cont)
+		continue_job(job);
+
+	while (job_state(job) == JOB_RUNNING)
+		sigsuspend(&orig);
+
+	if (job_control) {
+		tcsetpgrp(STDIN_FILENO, shell_pgid);
+		tcsetattr(STDIN_FILENO, TCSADRAIN, &shell_tmodes);
+	}
+
+	if (job_state(job) == JOB_STOPPED) {
+		if (current != job) {
+			previous = current;
+			current = job;
+		}
+		job->notified = true;
+		printf("\n[%d]+  Stopped\t\t%s\n", job->id, job->text);
+	} else {
+		status = last_status(job);
+		remove_job(job);
+	}
+
+	jobs_unblock(&orig);
+	return status;
+}
+
+void job_background(struct job *job) {
+	sigset_t orig;
+
+	jobs_block(&orig);
+	continue_job(job);
+	jobs_unblock(&orig);
+}
+
+int job_wait(struct job *job) {
+	sigset_t orig;
+	int status = -1;
+
+	jobs_block(&orig);
+	while (job_state(job) == JOB_RUNNING)
+		sigsuspend(&orig);
+
+	// a stopped job would never finish on its own
+	if (job_state(job) == JOB_DONE) {
+		status = last_status(job);
+		remove_job(job);
+	}
+	jobs_unblock(&orig);
+	return status;
+}
+
+static void describe(FILE *out, struct job *job, bool verbose) {
+	char state[32];
+	int status = last_status(job);
+
+	switch (job_state(job)) {
+	case JOB_RUNNING:
+		strcpy(state, "Running");
+		break;
+	case JOB_STOPPED:
+		strcpy(state, "Stopped");
+		break;
+	case JOB_DONE:
+		if (WIFSIGNALED(status))
+			snprintf(state, sizeof(state), "%s", strsignal(WTERMSIG(status)));
+		else if (WEXITSTATUS(status))
+			snprintf(state, sizeof(state), "Exit %d", WEXITSTATUS(status));
+		else
+			strcpy(state, "Done");
+		break;
+	}
+
+	fprintf(out, "[%d]%c  ", job->id,
+			job == current ? '+' : job == previous ? '-' : ' ');
+	if (verbose)
+		fprintf(out, "%-7d %6ld.%02lds user %4ld.%02lds sys  ", job->pgid,
+				(long)job->usage.ru_utime.tv_sec, (long)job->usage.ru_utime.tv_usec / 10000,
+				(long)job->usage.ru_stime.tv_sec, (long)job->usage.ru_stime.tv_usec / 10000);
+	fprintf(out, "%-22s %s\n", state, job->text);
+}
+
+void jobs_notify(FILE *out) {
+	sigset_t orig;
+
+	jobs_block(&orig);
+	for (int i = 0; i < job_count; i++) {
+		struct job *job = jobs[i];
+		enum job_state state = job_state(job);
+
+		if (state == JOB_RUNNING || job->notified)
+			continue;
+		if (out)
+			describe(out, job, false);
+		job->notified = true;
+		if (state == JOB_DONE) {
+			remove_job(job);
+			i--;
+		}
+	}
+	jobs_unblock(&orig);
+}
+
+void jobs_list(FILE *out, bool verbose) {
+	sigset_t orig;
+
+	jobs_block(&orig);
+	for (int i = 0; i < job_count; i++) {
+		struct job *job = jobs[i];
+		describe(out, job, verbose);
+		job->notified = true;
+		if (job_state(job) == JOB_DONE) {
+			remove_job(job);
+			i--;
+		}
+	}
+	jobs_unblock(&orig);
+}
+
+int jobs_count(void) {
+	return job_count;
+}
+
+struct job *job_at(int i) {
+	return i < job_count ? jobs[i] : NULL;
+}
@@ -0,0 +1,125 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+
+enum job_state {
+	JOB_RUNNING,
+	JOB_STOPPED,
+	JOB_DONE,
+};
+
+struct job_proc {
+	pid_t pid;
+	enum job_state state;
+	int status; // wait status once done
+};
+
+/**
+ * A pipeline started by the shell, one process group. The SIGCHLD handler
+ * reaps its processes as they finish and records their status here.
+ */
+struct job {
+	int id; // the n in %n
+	pid_t pgid;
+	char *text; // command line, for listings
+	bool notified; // a stop or finish has been reported
+	struct rusage usage; // summed over the reaped processes
+	int proc_count;
+	struct job_proc procs[];
+};
+
+/**
+ * Install the SIGCHLD handler. When interactive, also take the terminal
+ * and ignore the job control signals, which children get back by default.
+ * @param interactive [description]
+ */
+void jobs_init(bool interactive);
+
+/**
+ * Block SIGCHLD so the table can be changed; also keeps children from
+ * being reaped between their launch and job_add
+ * @param orig receives the previous signal mask
+ */
+void jobs_block(sigset_t *orig);
+
+/**
+ * Restore the signal mask saved by jobs_block
+ * @param orig [description]
+ */
+void jobs_unblock(const sigset_t *orig);
+
+/**
+ * Register a launched pipeline. Must be called with SIGCHLD blocked.
+ * @param  pgid  [description]
+ * @param  pids  one per stage
+ * @param  count [description]
+ * @param  text  malloc'd command line, owned by the job from now on
+ * @return       the new job
+ */
+struct job *job_add(pid_t pgid, const pid_t *pids, int count, char *text);
+
+/**
+ * Find a job by spec: %n, %+ or %% for the current job, %- for the one
+ * before it, or a pid of any of its processes. NULL or "" is the current job.
+ * @param  spec [description]
+ * @return      the job, NULL if none matches
+ */
+struct job *job_find(const char *spec);
+
+enum job_state job_state(struct job *job);
+
+/**
+ * Give a job the terminal, continue it if asked and wait until it
+ * finishes or stops. Finished jobs are removed from the table.
+ * @param  job  [description]
+ * @param  cont send SIGCONT first
+ * @return      wait status of the last stage, -1 if the job stopped
+ */
+int job_foreground(struct job *job, bool cont);
+
+/**
+ * Continue a stopped job without giving it the terminal
+ * @param job [description]
+ */
+void job_background(struct job *job);
+
+/**
+ * Wait until a job finishes and remove it from the table
+ * @param  job [description]
+ * @return     wait status of the last stage
+ */
+int job_wait(struct job *job);
+
+/**
+ * Report jobs that finished or stopped since the last call, and drop
+ * the finished ones
+ * @param out where to report, NULL to drop them silently
+ */
+void jobs_notify(FILE *out);
+
+/**
+ * Print the job table
+ * @param out     [description]
+ * @param verbose also print the process group and the CPU time used
+ */
+void jobs_list(FILE *out, bool verbose);
+
+/**
+ * Number of jobs in the table
+ * @return [description]
+ */
+int jobs_count(void);
+
+/**
+ * The job at a position of the table, for iteration
+ * @param  i [description]
+ * @return   [description]
+ */
+struct job *job_at(int i);
+
+#endif
@@ -0,0 +1,67 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <spawn.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "launch.h"
+
+extern char **environ;
+
+int launch_spawn(const char *path, char *const argv[], int in_fd, int out_fd, pid_t pgid, pid_t *pid) {
+	posix_spawn_file_actions_t actions;
+	posix_spawnattr_t attr;
+	sigset_t defaults, mask;
+	int r;
+
+	posix_spawn_file_actions_init(&actions);
+	posix_spawnattr_init(&attr);
+
+	// the descriptors handed in are close-on-exec, only the dup'd copies survive
+	if (in_fd >= 0 && in_fd != STDIN_FILENO)
+		posix_spawn_file_actions_adddup2(&actions, in_fd, STDIN_FILENO);
+	if (out_fd >= 0 && out_fd != STDOUT_FILENO)
+		posix_spawn_file_actions_adddup2(&actions, out_fd, STDOUT_FILENO);
+
+	// an interactive shell ignores the job control signals and launches
+	// with SIGCHLD blocked, the child must inherit neither
+	sigemptyset(&defaults);
+	sigaddset(&defaults, SIGINT);
+	sigaddset(&defaults, SIGQUIT);
+	sigaddset(&defaults, SIGTSTP);
+	sigaddset(&defaults, SIGTTIN);
+	sigaddset(&defaults, SIGTTOU);
+	posix_spawnattr_setsigdefault(&attr, &defaults);
+	sigemptyset(&mask);
+	posix_spawnattr_setsigmask(&attr, &mask);
+	posix_spawnattr_setpgroup(&attr, pgid);
+
+	short flags = POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK;
+#ifdef POSIX_SPAWN_USEVFORK
+	flags |= POSIX_SPAWN_USEVFORK;
+#endif
+	posix_spawnattr_setflags(&attr, flags);
+
+	r = posix_spawn(pid, path, &actions, &attr, argv, environ);
+	if (r == ENOEXEC) {
+		// as execvp does, hand an executable without a #! line to the shell
+		size_t n = 0;
+		while (argv[n])
+			n++;
+		char **sh_argv = malloc((n + 3) * sizeof(*sh_argv));
+		if (sh_argv) {
+			sh_argv[0] = "/bin/sh";
+			sh_argv[1] = (char *)path;
+			for (size_t i = 1; i <= n; i++)
+				sh_argv[i + 1] = argv[i];
+			sh_argv[n > 0 ? n + 1 : 2] = NULL;
+			r = posix_spawn(pid, "/bin/sh", &actions, &attr, sh_argv, environ);
+			free(sh_argv);
+		}
+	}
+
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&actions);
+	return r;
+}
@@ -0,0 +1,21 @@
+#ifndef LAUNCH_H
+#define LAUNCH_H
+
+#include <sys/types.h>
+
+/**
+ * Start a program without copying the shell's address space.
+ * Built on posix_spawn, which glibc implements with
+ * clone(CLONE_VM|CLONE_VFORK), so the cost does not grow with the shell's RSS.
+ * A file the kernel cannot execute is run by /bin/sh, as execvp would.
+ * @param  path      executable to run, no PATH search is done
+ * @param  argv      NULL terminated argument vector
+ * @param  in_fd     descriptor to install as stdin, -1 to inherit
+ * @param  out_fd    descriptor to install as stdout, -1 to inherit
+ * @param  pgid      process group to join, 0 to lead a new one
+ * @param  pid       receives the child's pid
+ * @return           0 on success, an errno value otherwise
+ */
+int launch_spawn(const char *path, char *const argv[], int in_fd, int out_fd, pid_t pgid, pid_t *pid);
+
+#endif
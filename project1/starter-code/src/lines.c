@@ -0,0 +1,159 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "lines.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LINES_X86 1
+#endif
+
+/**
+ * Word at a time fallback: a byte of x ^ '\n' is zero exactly where the
+ * newlines are, and the usual has-zero-byte trick finds it
+ */
+static const char *find_newline_scalar(const char *p, size_t n) {
+	const uint64_t ones = 0x0101010101010101ULL, highs = 0x8080808080808080ULL;
+	const uint64_t newlines = ones * '\n';
+	const char *end = p + n;
+
+	while (p + 8 <= end) {
+		uint64_t w;
+		memcpy(&w, p, 8);
+		w ^= newlines;
+		if ((w - ones) & ~w & highs)
+			break;
+		p += 8;
+	}
+	for (; p < end; p++)
+		if (*p == '\n')
+			return p;
+	return NULL;
+}
+
+#ifdef LINES_X86
+__attribute__((target("sse2")))
+static const char *find_newline_sse2(const char *p, size_t n) {
+	const __m128i newlines = _mm_set1_epi8('\n');
+	const char *end = p + n;
+
+	while (p + 16 <= end) {
+		__m128i v = _mm_loadu_si128((const __m128i *)p);
+		unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, newlines));
+		if (mask)
+			return p + __builtin_ctz(mask);
+		p += 16;
+	}
+	return find_newline_scalar(p, end - p);
+}
+
+__attribute__((target("avx2")))
+static const char *find_newline_avx2(const char *p, size_t n) {
+	const __m256i newlines = _mm256_set1_epi8('\n');
+	const char *end = p + n;
+
+	// two vectors per step, most lines are longer than 32 bytes
+	while (p + 64 <= end) {
+		__m256i a = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)p), newlines);
+		__m256i b = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + 32)), newlines);
+		if (!_mm256_testz_si256(_mm256_or_si256(a, b), _mm256_or_si256(a, b))) {
+			unsigned mask = _mm256_movemask_epi8(a);
+			if (mask)
+				return p + __builtin_ctz(mask);
+			return p + 32 + __builtin_ctz((unsigned)_mm256_movemask_epi8(b));
+		}
+		p += 64;
+	}
+	return find_newline_sse2(p, end - p);
+}
+#endif
+
+static const char *(*find_newline)(const char *, size_t);
+static pthread_once_t newline_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Pick the implementation for this CPU, once. uniq -j workers may get here
+ * together, so the pointer is only ever set under pthread_once.
+ */
+static void pick_newline(void) {
+	find_newline = find_newline_scalar;
+#ifdef LINES_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		find_newline = find_newline_avx2;
+	else if (__builtin_cpu_supports("sse2"))
+		find_newline = find_newline_sse2;
+#endif
+}
+
+const char *lines_find_newline(const char *p, size_t n) {
+	pthread_once(&newline_once, pick_newline);
+	return find_newline(p, n);
+}
+
+void lines_open_fd(struct line_source *src, int fd) {
+	struct stat st;
+
+	memset(src, 0, sizeof(*src));
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+		void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map != MAP_FAILED) {
+			madvise(map, st.st_size, MADV_SEQUENTIAL);
+			src->mapped = true;
+			src->data = map;
+			src->size = st.st_size;
+			src->reader.fd = fd;
+			// a shell's stdin may be partly read already, as in sh < script
+			off_t at = lseek(fd, 0, SEEK_CUR);
+			if (at > 0)
+				src->pos = at < st.st_size ? (size_t)at : src->size;
+			return;
+		}
+	}
+	reader_open_fd(&src->reader, fd, LINES_BLOCK);
+}
+
+int lines_open(struct line_source *src, const char *path) {
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return -1;
+	lines_open_fd(src, fd);
+	if (src->mapped) {
+		// the mapping keeps the file alive on its own
+		close(fd);
+		src->reader.fd = -1;
+	}
+	return 0;
+}
+
+const char *lines_next(struct line_source *src, size_t *len) {
+	if (!src->mapped)
+		return reader_next(&src->reader, len);
+
+	const char *p = src->data + src->pos;
+	size_t left = src->size - src->pos;
+	if (left == 0)
+		return NULL;
+	const char *nl = lines_find_newline(p, left);
+	*len = nl ? (size_t)(nl - p) : left;
+	src->pos += *len + (nl != NULL);
+	return p;
+}
+
+void lines_close(struct line_source *src) {
+	if (src->mapped) {
+		munmap((void *)src->data, src->size);
+		// the mapping was read to the end, leave a shared descriptor there
+		if (src->reader.fd != -1 && src->reader.fd <= STDERR_FILENO)
+			lseek(src->reader.fd, 0, SEEK_END);
+	}
+	// closes the descriptor, and frees the blocks if there are any
+	reader_close(&src->reader);
+	memset(src, 0, sizeof(*src));
+	src->reader.fd = -1;
+}
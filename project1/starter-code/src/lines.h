@@ -0,0 +1,67 @@
+#ifndef LINES_H
+#define LINES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "reader.h"
+
+/**
+ * Zero-copy line splitter for bulk data. Regular files are mapped whole and
+ * lines are handed out as views into the mapping. Pipes and terminals are
+ * read in big blocks by a line_reader instead. Lines may be of any length.
+ */
+struct line_source {
+	bool mapped;
+	const char *data; // the mapping
+	size_t size;      // bytes in data
+	size_t pos;       // first byte not handed out yet
+	struct line_reader reader; // owns the descriptor, and the blocks when not mapped
+};
+
+#define LINES_BLOCK (1024 * 1024)
+
+/**
+ * Find the first newline with the widest vector unit the CPU has
+ * @param  p [description]
+ * @param  n [description]
+ * @return   the newline, NULL if there is none in the n bytes
+ */
+const char *lines_find_newline(const char *p, size_t n);
+
+/**
+ * Split the data of a file descriptor, which is closed by lines_close
+ * unless it is one of the standard streams
+ * @param src [description]
+ * @param fd  [description]
+ */
+void lines_open_fd(struct line_source *src, int fd);
+
+/**
+ * @param  src  [description]
+ * @param  path [description]
+ * @return      0, or -1 with errno set
+ */
+int lines_open(struct line_source *src, const char *path);
+
+/**
+ * Next line without its newline, not NUL terminated
+ * @param  src [description]
+ * @param  len receives the line length
+ * @return     the line, NULL at the end. Lines of a mapped file stay valid
+ *             until lines_close, others only until the next call.
+ */
+const char *lines_next(struct line_source *src, size_t *len);
+
+/**
+ * Whether the lines handed out stay valid until lines_close
+ * @param  src [description]
+ * @return     [description]
+ */
+static inline bool lines_stable(const struct line_source *src) {
+	return src->mapped;
+}
+
+void lines_close(struct line_source *src);
+
+#endif
@@ -0,0 +1,101 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash.h"
+#include "lineset.h"
+
+void lineset_init(struct line_set *s) {
+	memset(s, 0, sizeof(*s));
+}
+
+static struct line_slot *find_slot(struct line_set *s, const char *line, size_t len, uint64_t hash) {
+	size_t mask = s->capacity - 1;
+	for (size_t i = hash & mask;; i = (i + 1) & mask) {
+		struct line_slot *slot = &s->slots[i];
+		if (!slot->index)
+			return slot;
+		if (slot->hash == hash) {
+			struct line_entry *e = &s->entries[slot->index - 1];
+			if (e->len == len && memcmp(e->line, line, len) == 0)
+				return slot;
+		}
+	}
+}
+
+static void grow(struct line_set *s) {
+	struct line_slot *old = s->slots;
+	size_t old_capacity = s->capacity;
+
+	s->capacity = s->capacity ? s->capacity * 2 : 1024;
+	s->slots = calloc(s->capacity, sizeof(*s->slots));
+	if (!s->slots)
+		abort();
+
+	// the stored hashes are enough to rehash, no string is looked at
+	size_t mask = s->capacity - 1;
+	for (size_t i = 0; i < old_capacity; i++) {
+		if (!old[i].index)
+			continue;
+		size_t j = old[i].hash & mask;
+		while (s->slots[j].index)
+			j = (j + 1) & mask;
+		s->slots[j] = old[i];
+	}
+	free(old);
+}
+
+struct line_entry *lineset_add(struct line_set *s, const char *line, size_t len, bool *added) {
+	return lineset_add_hashed(s, line, len, hash_bytes(line, len), added);
+}
+
+struct line_entry *lineset_add_hashed(struct line_set *s, const char *line, size_t len,
+									  uint64_t hash, bool *added) {
+	// keep the load factor under 1/2, probes stay short even for bad keys
+	if ((s->count + 1) * 2 > s->capacity)
+		grow(s);
+
+	struct line_slot *slot = find_slot(s, line, len, hash);
+	if (slot->index) {
+		if (added)
+			*added = false;
+		return &s->entries[slot->index - 1];
+	}
+
+	if (s->count == s->entries_capacity) {
+		s->entries_capacity = s->entries_capacity ? s->entries_capacity * 2 : 1024;
+		s->entries = realloc(s->entries, s->entries_capacity * sizeof(*s->entries));
+		if (!s->entries)
+			abort();
+	}
+
+	struct line_entry *e = &s->entries[s->count++];
+	if (s->borrow) {
+		e->line = line;
+	} else {
+		e->line = arena_strndup(&s->strings, line, len);
+		s->string_bytes += len + 1;
+	}
+	e->len = len;
+	e->hash = hash;
+	e->count = 0;
+	slot->hash = hash;
+	slot->index = s->count;
+	if (added)
+		*added = true;
+	return e;
+}
+
+size_t lineset_memory(const struct line_set *s) {
+	// a full table is about to double, and the old one lives until it has
+	size_t slots = s->capacity * sizeof(*s->slots);
+	if ((s->count + 1) * 2 > s->capacity)
+		slots = 3 * (slots ? slots : 1024 * sizeof(*s->slots));
+	return slots + s->entries_capacity * sizeof(*s->entries) + s->string_bytes;
+}
+
+void lineset_free(struct line_set *s) {
+	free(s->slots);
+	free(s->entries);
+	arena_free(&s->strings);
+	memset(s, 0, sizeof(*s));
+}
@@ -0,0 +1,64 @@
+#ifndef LINESET_H
+#define LINESET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+/**
+ * Set of distinct lines that remembers the order they were first seen in.
+ * Lines are copied into an arena, so the caller's buffer can be reused.
+ */
+struct line_entry {
+	const char *line; // NUL terminated copy, unless the set borrows
+	size_t len;
+	uint64_t hash;
+	uint64_t count;   // left to the caller, zero for a new line
+};
+
+struct line_slot {
+	uint64_t hash;   // cached so most probes never touch the entry
+	size_t index;    // into entries, plus one, zero for an empty slot
+};
+
+struct line_set {
+	struct line_slot *slots; // open addressing, power of two capacity
+	size_t capacity;
+	struct line_entry *entries; // in first-seen order
+	size_t count;
+	size_t entries_capacity;
+	struct arena strings;
+	size_t string_bytes; // copied into strings so far
+	bool borrow; // lines outlive the set, keep pointers instead of copies
+};
+
+void lineset_init(struct line_set *s);
+
+/**
+ * Find a line, inserting it if it has not been seen before
+ * @param  s     [description]
+ * @param  line  need not be NUL terminated
+ * @param  len   [description]
+ * @param  added set to whether the line was new, may be NULL
+ * @return       the entry, valid until the next insertion
+ */
+struct line_entry *lineset_add(struct line_set *s, const char *line, size_t len, bool *added);
+
+/**
+ * lineset_add with the hash already known, e.g. from another set
+ */
+struct line_entry *lineset_add_hashed(struct line_set *s, const char *line, size_t len,
+									  uint64_t hash, bool *added);
+
+/**
+ * Heap memory held by the set, about what another insertion would need
+ * @param  s [description]
+ * @return   [description]
+ */
+size_t lineset_memory(const struct line_set *s);
+
+void lineset_free(struct line_set *s);
+
+#endif
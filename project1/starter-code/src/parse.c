@@ -0,0 +1,179 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "shelly.h"
+
+/**
+ * Prints a command struct
+ * @param struct command_t *
+ */
+void print_command(struct command_t *command) {
+	int i = 0;
+	printf("Command: <%s>\n", command->name);
+	printf("\tIs Background: %s\n", command->background ? "yes" : "no");
+	printf("\tNeeds Auto-complete: %s\n",
+		   command->auto_complete ? "yes" : "no");
+	printf("\tRedirects:\n");
+
+	for (i = 0; i < 3; i++) {
+		printf("\t\t%d: %s\n", i,
+			   command->redirects[i] ? command->redirects[i] : "N/A");
+	}
+
+	printf("\tArguments (%d):\n", command->arg_count);
+
+	for (i = 0; i < command->arg_count; ++i) {
+		printf("\t\tArg %d: %s\n", i, command->args[i]);
+	}
+
+	if (command->next) {
+		printf("\tPiped to:\n");
+		print_command(command->next);
+	}
+}
+
+/**
+ * Characters that end an unquoted word
+ * @param  c [description]
+ * @return   [description]
+ */
+static bool is_delimiter(char c) {
+	return c == 0 || c == ' ' || c == '\t' || c == '|' || c == '&' ||
+		   c == '<' || c == '>';
+}
+
+/**
+ * Close the argument vector of a pipeline stage
+ * @param stage [description]
+ * @param argv  words of the stage, with room for the NULL after them
+ * @param argc  [description]
+ */
+static void finish_stage(struct command_t *stage, char **argv, int argc) {
+	static char empty[1];
+
+	if (argc == 0)
+		argv[argc++] = empty;
+	argv[argc] = NULL;
+	stage->name = argv[0];
+	stage->args = argv;
+	stage->arg_count = argc + 1;
+}
+
+int parse_command(char *buf, struct command_t *command, struct arena *arena) {
+	size_t len = strlen(buf);
+
+	// trim right whitespace
+	while (len > 0 && (buf[len - 1] == ' ' || buf[len - 1] == '\t'))
+		buf[--len] = 0;
+
+	// auto-complete, the '?' stays part of the word, ls file? keeps its glob
+	if (len > 0 && buf[len - 1] == '?' && (len < 2 || buf[len - 2] != '\\'))
+		command->auto_complete = true;
+
+	// every word takes at least one character and a delimiter, so the words
+	// plus one NULL per stage always fit in len + 2 slots
+	char **argv = arena_alloc(arena, sizeof(char *) * (len + 2));
+	struct command_t *stage = command;
+	int argc = 0;
+	int redirect = -1; // redirect still waiting for its file name
+	bool background = false;
+
+	// words are unquoted in place: w trails r and only ever copies down.
+	// The NUL after a word goes where its delimiter was, which may still
+	// be an operator, so it is only written once r has moved past it.
+	char *r = buf, *w = buf, *pending = NULL;
+
+	while (1) {
+		while (*r == ' ' || *r == '\t')
+			r++;
+		char c = *r;
+
+		if (c != 0 && background)
+			goto syntax_error; // '&' only ends a command line
+
+		if (c == '|' || c == '&' || c == '<' || c == '>') {
+			if (redirect != -1)
+				goto syntax_error;
+
+			if (c == '<')
+				redirect = 0;
+			else if (c == '>')
+				redirect = r[1] == '>' ? 2 : 1;
+			r += redirect == 2 ? 2 : 1;
+			if (pending) {
+				*pending = 0;
+				pending = NULL;
+			}
+
+			if (c == '|') {
+				if (argc == 0 && !stage->redirects[0] && !stage->redirects[1] &&
+					!stage->redirects[2])
+					goto syntax_error;
+				finish_stage(stage, argv, argc);
+				argv += stage->arg_count;
+				argc = 0;
+				stage->next = arena_calloc(arena, sizeof(struct command_t));
+				stage = stage->next;
+			} else if (c == '&') {
+				background = true;
+			}
+			continue;
+		}
+
+		if (pending) {
+			*pending = 0;
+			pending = NULL;
+		}
+		if (c == 0)
+			break;
+
+		char *word = w;
+		while (!is_delimiter(*r)) {
+			if (*r == '\\' && r[1]) {
+				// escaped character, taken literally
+				*w++ = r[1];
+				r += 2;
+			} else if (*r == '\'') {
+				// single quotes, nothing special inside
+				for (r++; *r && *r != '\''; )
+					*w++ = *r++;
+				if (!*r++)
+					goto syntax_error;
+			} else if (*r == '"') {
+				// double quotes, only \" and \\ are escapes inside
+				for (r++; *r && *r != '"'; ) {
+					if (*r == '\\' && (r[1] == '"' || r[1] == '\\'))
+						r++;
+					*w++ = *r++;
+				}
+				if (!*r++)
+					goto syntax_error;
+			} else {
+				*w++ = *r++;
+			}
+		}
+		pending = w++;
+
+		if (redirect != -1) {
+			stage->redirects[redirect] = word;
+			redirect = -1;
+		} else {
+			argv[argc++] = word;
+		}
+	}
+
+	if (redirect != -1 || (argc == 0 && stage != command))
+		goto syntax_error;
+	finish_stage(stage, argv, argc);
+
+	for (stage = command; stage; stage = stage->next)
+		stage->background = background;
+	return 0;
+
+syntax_error:
+	memset(command, 0, sizeof(*command));
+	argv = arena_alloc(arena, sizeof(char *) * 2);
+	finish_stage(command, argv, 0);
+	return -1;
+}
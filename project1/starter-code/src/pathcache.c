@@ -0,0 +1,203 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "hash.h"
+#include "pathcache.h"
+
+struct path_entry {
+	char *name; // NULL for an empty slot
+	char *path;
+	uint64_t hash;
+	unsigned hits;
+};
+
+// open addressing with linear probing, capacity is always a power of two
+static struct path_entry *table;
+static size_t capacity, count;
+static char *cached_path_env; // PATH value the entries were resolved against
+
+static struct path_entry *find_slot(const char *name, uint64_t hash) {
+	size_t mask = capacity - 1;
+	for (size_t i = hash & mask;; i = (i + 1) & mask) {
+		struct path_entry *e = &table[i];
+		if (!e->name || (e->hash == hash && strcmp(e->name, name) == 0))
+			return e;
+	}
+}
+
+static void grow(void) {
+	struct path_entry *old = table;
+	size_t old_capacity = capacity;
+
+	capacity = capacity ? capacity * 2 : 64;
+	table = calloc(capacity, sizeof(*table));
+	for (size_t i = 0; i < old_capacity; i++)
+		if (old[i].name)
+			*find_slot(old[i].name, old[i].hash) = old[i];
+	free(old);
+}
+
+/**
+ * Search PATH the way execvp does, but only with stat(), never execve()
+ * @param  name [description]
+ * @param  env  value of PATH
+ * @param  absolute set to whether the match came from an absolute directory
+ * @return      malloc'd path or NULL
+ */
+static char *search_path(const char *name, const char *env, bool *absolute) {
+	size_t name_len = strlen(name);
+	const char *dir = env;
+
+	while (1) {
+		const char *end = strchr(dir, ':');
+		size_t dir_len = end ? (size_t)(end - dir) : strlen(dir);
+		char *candidate = malloc(dir_len + name_len + 3);
+		struct stat st;
+
+		// an empty component means the current directory
+		if (dir_len == 0)
+			strcpy(candidate, ".");
+		else
+			memcpy(candidate, dir, dir_len), candidate[dir_len] = 0;
+		strcat(candidate, "/");
+		strcat(candidate, name);
+
+		if (stat(candidate, &st) == 0 && S_ISREG(st.st_mode) &&
+			access(candidate, X_OK) == 0) {
+			*absolute = dir_len > 0 && dir[0] == '/';
+			return candidate;
+		}
+		free(candidate);
+
+		if (!end)
+			return NULL;
+		dir = end + 1;
+	}
+}
+
+/**
+ * Flush the cache if PATH changed since the entries were resolved
+ * @return current value of PATH
+ */
+static const char *check_path_env(void) {
+	const char *env = getenv("PATH");
+	if (!env)
+		env = "/bin:/usr/bin";
+
+	if (!cached_path_env || strcmp(cached_path_env, env) != 0) {
+		pathcache_clear();
+		cached_path_env = strdup(env);
+	}
+	return env;
+}
+
+static void insert(const char *name, uint64_t hash, char *path) {
+	if ((count + 1) * 4 > capacity * 3)
+		grow();
+	struct path_entry *e = find_slot(name, hash);
+	if (e->name) {
+		free(e->path);
+	} else {
+		e->name = strdup(name);
+		e->hash = hash;
+		count++;
+	}
+	e->path = path;
+	e->hits = 0;
+}
+
+const char *pathcache_lookup(const char *name) {
+	static char *uncached; // last relative-directory match, not remembered
+	bool absolute;
+
+	if (strchr(name, '/'))
+		return name;
+	const char *env = check_path_env();
+
+	uint64_t hash = hash_bytes(name, strlen(name));
+	if (capacity) {
+		struct path_entry *e = find_slot(name, hash);
+		if (e->name) {
+			e->hits++;
+			return e->path;
+		}
+	}
+
+	char *path = search_path(name, env, &absolute);
+	if (!path)
+		return NULL;
+
+	// like bash, results from relative PATH entries depend on the cwd
+	if (!absolute) {
+		free(uncached);
+		uncached = path;
+		return path;
+	}
+
+	insert(name, hash, path);
+	find_slot(name, hash)->hits = 1;
+	return path;
+}
+
+void pathcache_remember(const char *name, const char *path) {
+	check_path_env();
+	insert(name, hash_bytes(name, strlen(name)), strdup(path));
+}
+
+void pathcache_forget(const char *name) {
+	if (!capacity)
+		return;
+
+	size_t mask = capacity - 1;
+	struct path_entry *e = find_slot(name, hash_bytes(name, strlen(name)));
+	if (!e->name)
+		return;
+	free(e->name);
+	free(e->path);
+	e->name = NULL;
+	count--;
+
+	// backward shift deletion keeps probe chains intact without tombstones
+	size_t hole = e - table;
+	for (size_t i = (hole + 1) & mask; table[i].name; i = (i + 1) & mask) {
+		size_t home = table[i].hash & mask;
+		if (((i - home) & mask) >= ((i - hole) & mask)) {
+			table[hole] = table[i];
+			table[i].name = NULL;
+			hole = i;
+		}
+	}
+}
+
+void pathcache_clear(void) {
+	for (size_t i = 0; i < capacity; i++) {
+		free(table[i].name);
+		free(table[i].path);
+	}
+	free(table);
+	table = NULL;
+	capacity = count = 0;
+	free(cached_path_env);
+	cached_path_env = NULL;
+}
+
+void pathcache_list(FILE *out, int reusable) {
+	if (!count) {
+		fprintf(out, "hash table empty\n");
+		return;
+	}
+
+	if (!reusable)
+		fprintf(out, "hits\tcommand\n");
+	for (size_t i = 0; i < capacity; i++) {
+		if (!table[i].name)
+			continue;
+		if (reusable)
+			fprintf(out, "hash -p %s %s\n", table[i].path, table[i].name);
+		else
+			fprintf(out, "%4u\t%s\n", table[i].hits, table[i].path);
+	}
+}
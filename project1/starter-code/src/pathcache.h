@@ -0,0 +1,40 @@
+#ifndef PATHCACHE_H
+#define PATHCACHE_H
+
+#include <stdio.h>
+
+/**
+ * Resolve a command name to the absolute path of an executable in PATH.
+ * Results are remembered until PATH changes, so repeated launches skip the
+ * directory search. Names containing a '/' are returned as they are.
+ * @param  name command name
+ * @return      path owned by the cache, NULL if nothing was found
+ */
+const char *pathcache_lookup(const char *name);
+
+/**
+ * Remember a path for a command name without searching PATH
+ * @param name [description]
+ * @param path [description]
+ */
+void pathcache_remember(const char *name, const char *path);
+
+/**
+ * Drop one remembered path, e.g. after exec reported it missing
+ * @param name [description]
+ */
+void pathcache_forget(const char *name);
+
+/**
+ * Drop every remembered path
+ */
+void pathcache_clear(void);
+
+/**
+ * Print the cache contents
+ * @param out      [description]
+ * @param reusable print as hash -p commands instead of a hits table
+ */
+void pathcache_list(FILE *out, int reusable);
+
+#endif
@@ -0,0 +1,171 @@
+#include <pwd.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/utsname.h>
+
+#include "prompt_cache.h"
+
+// seconds between checks of the hostname, which almost never changes
+#define HOSTNAME_CHECK_INTERVAL 10
+
+enum segment_type {
+	SEG_TEXT,
+	SEG_USER,
+	SEG_HOST,
+	SEG_CWD,
+	SEG_CWD_BASE,
+	SEG_SHELL,
+	SEG_PRIVILEGE,
+};
+
+struct segment {
+	enum segment_type type;
+	const char *text; // SEG_TEXT only, not NUL terminated
+	size_t len;
+};
+
+static struct segment *segments;
+static int segment_count;
+
+static const char *shell_name = "";
+static char *user;
+static char hostname[sizeof(((struct utsname *)0)->nodename)];
+static char *cwd;
+static time_t hostname_checked;
+
+static char *rendered;
+static size_t rendered_len;
+static bool dirty = true;
+
+static void add_segment(enum segment_type type, const char *text, size_t len) {
+	segments = realloc(segments, sizeof(*segments) * (segment_count + 1));
+	segments[segment_count].type = type;
+	segments[segment_count].text = text;
+	segments[segment_count].len = len;
+	segment_count++;
+}
+
+static void compile(const char *format) {
+	const char *p = format;
+
+	while (*p) {
+		const char *percent = strchr(p, '%');
+		size_t len = percent ? (size_t)(percent - p) : strlen(p);
+		if (len)
+			add_segment(SEG_TEXT, p, len);
+		if (!percent)
+			break;
+
+		p = percent + 2;
+		switch (percent[1]) {
+		case 'u': add_segment(SEG_USER, NULL, 0); break;
+		case 'h': add_segment(SEG_HOST, NULL, 0); break;
+		case 'w': add_segment(SEG_CWD, NULL, 0); break;
+		case 'W': add_segment(SEG_CWD_BASE, NULL, 0); break;
+		case 's': add_segment(SEG_SHELL, NULL, 0); break;
+		case '$': add_segment(SEG_PRIVILEGE, NULL, 0); break;
+		case '%': add_segment(SEG_TEXT, "%", 1); break;
+		case 0: // a lone '%' at the end
+			add_segment(SEG_TEXT, "%", 1);
+			p = percent + 1;
+			break;
+		default: // unknown escapes are printed as they are
+			add_segment(SEG_TEXT, percent, 2);
+			break;
+		}
+	}
+}
+
+static void read_hostname(void) {
+	struct utsname u;
+	if (uname(&u) == 0 && strcmp(u.nodename, hostname) != 0) {
+		strcpy(hostname, u.nodename);
+		dirty = true;
+	}
+	hostname_checked = time(NULL);
+}
+
+void prompt_cache_init(const char *format, const char *sysname) {
+	shell_name = sysname;
+	compile(strdup(format ? format : "%u@%h:%w %s$ "));
+
+	const char *name = getenv("USER");
+	if (!name) {
+		struct passwd *pw = getpwuid(geteuid());
+		name = pw ? pw->pw_name : "?";
+	}
+	user = strdup(name);
+
+	read_hostname();
+	prompt_cache_cwd_changed();
+}
+
+void prompt_cache_cwd_changed(void) {
+	free(cwd);
+	cwd = getcwd(NULL, 0);
+	if (!cwd)
+		cwd = strdup("?");
+	dirty = true;
+}
+
+static void render(void) {
+	size_t cap = 64, len = 0;
+	char *out = malloc(cap);
+
+	for (int i = 0; i < segment_count; i++) {
+		const char *text = segments[i].text;
+		size_t n = segments[i].len;
+		const char *slash;
+
+		switch (segments[i].type) {
+		case SEG_TEXT: break;
+		case SEG_USER: text = user; break;
+		case SEG_HOST: text = hostname; break;
+		case SEG_CWD: text = cwd; break;
+		case SEG_CWD_BASE:
+			slash = strrchr(cwd, '/');
+			text = slash && slash[1] ? slash + 1 : cwd;
+			break;
+		case SEG_SHELL: text = shell_name; break;
+		case SEG_PRIVILEGE: text = geteuid() == 0 ? "#" : "$"; break;
+		}
+		if (segments[i].type != SEG_TEXT)
+			n = strlen(text);
+
+		if (len + n > cap) {
+			while (len + n > cap)
+				cap *= 2;
+			out = realloc(out, cap);
+		}
+		memcpy(out + len, text, n);
+		len += n;
+	}
+
+	free(rendered);
+	rendered = out;
+	rendered_len = len;
+	dirty = false;
+}
+
+void prompt_cache_show(void) {
+	if (!segments)
+		prompt_cache_init(NULL, shell_name);
+	if (time(NULL) - hostname_checked >= HOSTNAME_CHECK_INTERVAL)
+		read_hostname();
+	if (dirty)
+		render();
+
+	// anything printf'd before must come out first
+	fflush(stdout);
+	size_t done = 0;
+	while (done < rendered_len) {
+		ssize_t n = write(STDOUT_FILENO, rendered + done, rendered_len - done);
+		if (n <= 0)
+			break;
+		done += n;
+	}
+}
@@ -0,0 +1,24 @@
+#ifndef PROMPT_CACHE_H
+#define PROMPT_CACHE_H
+
+/**
+ * Compile a prompt format into segments. The rendered prompt is cached and
+ * only rebuilt when the directory or the hostname changes.
+ *   %u user    %h hostname    %w working directory    %W its last part
+ *   %s shell name    %$ '#' for root, '$' otherwise    %% a '%'
+ * @param format  NULL for the default "%u@%h:%w %s$ "
+ * @param sysname expansion of %s
+ */
+void prompt_cache_init(const char *format, const char *sysname);
+
+/**
+ * Print the prompt with a single write
+ */
+void prompt_cache_show(void);
+
+/**
+ * Call after a successful chdir
+ */
+void prompt_cache_cwd_changed(void);
+
+#endif
@@ -0,0 +1,120 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "lines.h"
+#include "reader.h"
+
+void reader_open_fd(struct line_reader *r, int fd, size_t block) {
+	memset(r, 0, sizeof(*r));
+	r->fd = fd;
+	r->synced = -1;
+	r->block = block;
+	r->size = block;
+	r->buf = malloc(r->size);
+}
+
+void reader_open_mem(struct line_reader *r, const char *data, size_t len) {
+	memset(r, 0, sizeof(*r));
+	r->fd = -1;
+	r->synced = -1;
+	r->block = READER_BLOCK;
+	r->size = len + 1;
+	r->buf = malloc(r->size);
+	memcpy(r->buf, data, len);
+	r->end = len;
+	r->eof = true;
+}
+
+void reader_share(struct line_reader *r) {
+	if (lseek(r->fd, 0, SEEK_CUR) != -1)
+		r->seekable = true;
+	else
+		r->bytewise = true;
+}
+
+void reader_sync(struct line_reader *r) {
+	if (r->seekable && r->start != r->end)
+		r->synced = lseek(r->fd, (off_t)r->start - (off_t)r->end, SEEK_CUR);
+}
+
+/**
+ * After reader_sync: take the block back if the descriptor was not read,
+ * drop it otherwise
+ * @param r [description]
+ */
+static void resume(struct line_reader *r) {
+	off_t ahead = r->end - r->start;
+	if (lseek(r->fd, 0, SEEK_CUR) != r->synced || lseek(r->fd, ahead, SEEK_CUR) == -1) {
+		r->end = r->start;
+		r->scanned = 0;
+		r->eof = false;
+	}
+	r->synced = -1;
+}
+
+/**
+ * Make room for at least one more block after end and read it
+ * @param r [description]
+ */
+static void fill(struct line_reader *r) {
+	if (r->start > 0) {
+		memmove(r->buf, r->buf + r->start, r->end - r->start);
+		r->end -= r->start;
+		r->start = 0;
+	}
+	// keep a byte for the NUL of a last line without a newline
+	if (r->size - r->end < r->block / 2 + 1) {
+		r->size *= 2;
+		r->buf = realloc(r->buf, r->size);
+	}
+
+	ssize_t n;
+	do {
+		n = read(r->fd, r->buf + r->end, r->bytewise ? 1 : r->size - r->end - 1);
+	} while (n == -1 && errno == EINTR);
+
+	if (n <= 0)
+		r->eof = true;
+	else
+		r->end += n;
+}
+
+char *reader_next(struct line_reader *r, size_t *len) {
+	if (r->synced != -1)
+		resume(r);
+	while (1) {
+		char *p = r->buf + r->start;
+		char *nl = (char *)lines_find_newline(p + r->scanned, r->end - r->start - r->scanned);
+
+		if (nl) {
+			*nl = 0;
+			if (len)
+				*len = nl - p;
+			r->start = nl + 1 - r->buf;
+			r->scanned = 0;
+			return p;
+		}
+		r->scanned = r->end - r->start;
+
+		if (r->eof) {
+			if (r->start == r->end)
+				return NULL;
+			r->buf[r->end] = 0;
+			if (len)
+				*len = r->end - r->start;
+			r->start = r->end;
+			r->scanned = 0;
+			return p;
+		}
+		fill(r);
+	}
+}
+
+void reader_close(struct line_reader *r) {
+	if (r->fd > STDERR_FILENO)
+		close(r->fd);
+	free(r->buf);
+	r->buf = NULL;
+}
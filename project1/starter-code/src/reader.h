@@ -0,0 +1,73 @@
+#ifndef READER_H
+#define READER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ * Line reader for non-interactive input and pipes. Reads big blocks and
+ * splits them with lines_find_newline, lines are handed out in place and
+ * may be of any length.
+ */
+struct line_reader {
+	int fd; // -1 once everything is in buf
+	char *buf;
+	size_t size; // allocated bytes
+	size_t block; // bytes asked for by one read
+	size_t start, end; // bytes not handed out yet
+	size_t scanned; // bytes after start already known to hold no newline
+	bool eof;
+	bool seekable; // reader_sync gives unread bytes back
+	off_t synced; // offset reader_sync left the fd at, -1 if none
+	bool bytewise; // read a byte at a time, the fd cannot take them back
+};
+
+#define READER_BLOCK (64 * 1024)
+
+/**
+ * Read lines from a file descriptor
+ * @param r     [description]
+ * @param fd    [description]
+ * @param block bytes read at a time, READER_BLOCK for commands
+ */
+void reader_open_fd(struct line_reader *r, int fd, size_t block);
+
+/**
+ * Read lines from a copy of a string
+ * @param r    [description]
+ * @param data [description]
+ * @param len  [description]
+ */
+void reader_open_mem(struct line_reader *r, const char *data, size_t len);
+
+/**
+ * The descriptor is shared with the commands the caller runs, which must
+ * find their input where the last line handed out ended. Seekable input
+ * is still read in blocks and handed back by reader_sync; pipes are read
+ * a byte at a time, as POSIX shells do.
+ * @param r [description]
+ */
+void reader_share(struct line_reader *r);
+
+/**
+ * Seek the descriptor back to the first byte not handed out yet, before
+ * running a command that may read it. The last line stays valid. If the
+ * command read nothing, the next reader_next seeks forward again and
+ * keeps the block it has, otherwise it reads on from the new offset.
+ * @param r [description]
+ */
+void reader_sync(struct line_reader *r);
+
+/**
+ * Next line, without its newline and NUL terminated. The line stays valid,
+ * and may be modified, until the next call.
+ * @param  r   [description]
+ * @param  len receives the line length, may be NULL
+ * @return     the line, NULL at the end of input
+ */
+char *reader_next(struct line_reader *r, size_t *len);
+
+void reader_close(struct line_reader *r);
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef SHELLY_H
+#define SHELLY_H
+
+#include <stdbool.h>
+
+#include "arena.h"
+
+enum return_codes {
+	SUCCESS = 0,
+	EXIT = 1,
+	UNKNOWN = 2,
+};
+
+struct command_t {
+	char *name;
+	bool background;
+	bool auto_complete;
+	int arg_count;
+	char **args;
+	char *redirects[3]; // in/out redirection
+	struct command_t *next; // for piping
+};
+
+/**
+ * Prints a command struct
+ * @param struct command_t *
+ */
+void print_command(struct command_t *command);
+
+/**
+ * Parse a command string into a command struct in a single pass.
+ * Words are unquoted in place and the command points into buf, so buf
+ * must live as long as the command; everything else is allocated in the
+ * arena and dies with it.
+ * @param  buf     [description]
+ * @param  command [description]
+ * @param  arena   [description]
+ * @return         0, or -1 on a syntax error, leaving an empty command
+ */
+int parse_command(char *buf, struct command_t *command, struct arena *arena);
+
+#endif
@@ -0,0 +1,256 @@
+#include <errno.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash.h"
+#include "sketch.h"
+
+void hll_init(struct hll *h) {
+	memset(h, 0, sizeof(*h));
+}
+
+void hll_add(struct hll *h, uint64_t hash) {
+	unsigned i = hash >> (64 - HLL_BITS);
+	// the marker bit caps the rank when the remaining bits are all zero
+	uint64_t rest = (hash << HLL_BITS) | (1ULL << (HLL_BITS - 1));
+	uint8_t rank = __builtin_clzll(rest) + 1;
+	if (rank > h->registers[i])
+		h->registers[i] = rank;
+}
+
+double hll_estimate(const struct hll *h) {
+	const double m = HLL_REGISTERS;
+	double sum = 0;
+	unsigned zeros = 0;
+
+	for (int i = 0; i < HLL_REGISTERS; i++) {
+		sum += ldexp(1.0, -h->registers[i]);
+		zeros += h->registers[i] == 0;
+	}
+
+	double alpha = 0.7213 / (1 + 1.079 / m);
+	double e = alpha * m * m / sum;
+
+	// small cardinalities leave empty registers, count those instead
+	if (e <= 2.5 * m && zeros)
+		e = m * log(m / zeros);
+	return e;
+}
+
+void cm_init(struct count_min *cm) {
+	memset(cm, 0, sizeof(*cm));
+}
+
+/**
+ * Column of a row. Every row remixes the hash on its own: deriving the rows
+ * from two halves of one hash leaves only 2^18 column patterns, and a rare
+ * line sharing all of them with a heavy one is then counted as heavy.
+ */
+static inline unsigned cm_column(uint64_t hash, int row) {
+	return hash_mix(hash + (row + 1) * 0x9e3779b97f4a7c15ULL) % CM_WIDTH;
+}
+
+uint32_t cm_estimate(const struct count_min *cm, uint64_t hash) {
+	uint32_t min = UINT32_MAX;
+	for (int row = 0; row < CM_DEPTH; row++) {
+		uint32_t c = cm->counters[row][cm_column(hash, row)];
+		if (c < min)
+			min = c;
+	}
+	return min;
+}
+
+uint32_t cm_add(struct count_min *cm, uint64_t hash) {
+	uint32_t estimate = cm_estimate(cm, hash);
+	if (estimate == UINT32_MAX)
+		return estimate;
+
+	estimate++;
+	for (int row = 0; row < CM_DEPTH; row++) {
+		uint32_t *c = &cm->counters[row][cm_column(hash, row)];
+		if (*c < estimate)
+			*c = estimate;
+	}
+	cm->total++;
+	return estimate;
+}
+
+int topk_init(struct top_k *t, size_t k) {
+	memset(t, 0, sizeof(*t));
+	if (k > TOPK_MAX) {
+		errno = EINVAL;
+		return -1;
+	}
+	cm_init(&t->cm);
+	t->k = k;
+
+	size_t capacity = 16;
+	while (capacity < 2 * k)
+		capacity *= 2;
+	// one spare entry, so that k = 0 asks for memory as well
+	t->heap = calloc(k + 1, sizeof(*t->heap));
+	t->index = malloc(capacity * sizeof(*t->index));
+	if (!t->heap || !t->index) {
+		free(t->heap);
+		free(t->index);
+		memset(t, 0, sizeof(*t));
+		errno = ENOMEM;
+		return -1;
+	}
+	memset(t->index, -1, capacity * sizeof(*t->index));
+	t->index_mask = capacity - 1;
+	return 0;
+}
+
+/**
+ * Slot of the index holding a line, or the free slot where it would go
+ */
+static size_t index_find(const struct top_k *t, uint64_t hash, const char *line, size_t len) {
+	for (size_t i = hash & t->index_mask;; i = (i + 1) & t->index_mask) {
+		int32_t pos = t->index[i];
+		if (pos == -1)
+			return i;
+		const struct top_entry *e = &t->heap[pos];
+		if (e->hash == hash && e->len == len && memcmp(e->line, line, len) == 0)
+			return i;
+	}
+}
+
+static size_t index_of(const struct top_k *t, const struct top_entry *e) {
+	return index_find(t, e->hash, e->line, e->len);
+}
+
+/**
+ * Remove a slot without tombstones, shifting later entries of its cluster
+ * back where lookups still find them
+ */
+static void index_remove(struct top_k *t, size_t i) {
+	size_t j = i;
+	while (1) {
+		j = (j + 1) & t->index_mask;
+		if (t->index[j] == -1)
+			break;
+		size_t home = t->heap[t->index[j]].hash & t->index_mask;
+		// move j back to i unless its home lies cyclically in (i, j]
+		if (((j - home) & t->index_mask) >= ((j - i) & t->index_mask)) {
+			t->index[i] = t->index[j];
+			i = j;
+		}
+	}
+	t->index[i] = -1;
+}
+
+static void heap_swap(struct top_k *t, size_t a, size_t b) {
+	// lookups compare against the heap, so find both slots before swapping
+	size_t slot_a = index_of(t, &t->heap[a]), slot_b = index_of(t, &t->heap[b]);
+	struct top_entry tmp = t->heap[a];
+	t->heap[a] = t->heap[b];
+	t->heap[b] = tmp;
+	t->index[slot_a] = b;
+	t->index[slot_b] = a;
+}
+
+static void heap_down(struct top_k *t, size_t i) {
+	while (1) {
+		size_t l = 2 * i + 1, r = l + 1, m = i;
+		if (l < t->count && t->heap[l].estimate < t->heap[m].estimate)
+			m = l;
+		if (r < t->count && t->heap[r].estimate < t->heap[m].estimate)
+			m = r;
+		if (m == i)
+			return;
+		heap_swap(t, i, m);
+		i = m;
+	}
+}
+
+static void heap_up(struct top_k *t, size_t i) {
+	while (i && t->heap[i].estimate < t->heap[(i - 1) / 2].estimate) {
+		heap_swap(t, i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+/**
+ * Make room for a line in an entry's buffer, which is then filled by
+ * set_line. Kept apart so that a failure leaves the entry as it was.
+ * @return false if the buffer cannot grow
+ */
+static bool reserve_line(struct top_entry *e, size_t len) {
+	if (len <= e->size)
+		return true;
+	char *line = realloc(e->line, len);
+	if (!line)
+		return false;
+	e->line = line;
+	e->size = len;
+	return true;
+}
+
+static void set_line(struct top_entry *e, const char *line, size_t len) {
+	memcpy(e->line, line, len);
+	e->len = len;
+}
+
+int topk_add(struct top_k *t, const char *line, size_t len) {
+	uint64_t hash = hash_bytes(line, len);
+	uint32_t estimate = cm_add(&t->cm, hash);
+
+	size_t slot = index_find(t, hash, line, len);
+	if (t->index[slot] != -1) {
+		// estimates only grow, it can only sink away from the root
+		size_t pos = t->index[slot];
+		t->heap[pos].estimate = estimate;
+		heap_down(t, pos);
+		return 0;
+	}
+
+	if (t->count < t->k) {
+		size_t pos = t->count;
+		struct top_entry *e = &t->heap[pos];
+		if (!reserve_line(e, len))
+			goto nomem;
+		t->count++;
+		e->hash = hash;
+		e->estimate = estimate;
+		set_line(e, line, len);
+		t->index[slot] = pos;
+		heap_up(t, pos);
+	} else if (t->k && estimate > t->heap[0].estimate) {
+		// evict the weakest candidate, reusing its line buffer
+		struct top_entry *e = &t->heap[0];
+		if (!reserve_line(e, len))
+			goto nomem;
+		index_remove(t, index_of(t, e));
+		e->hash = hash;
+		e->estimate = estimate;
+		set_line(e, line, len);
+		t->index[index_find(t, hash, line, len)] = 0;
+		heap_down(t, 0);
+	}
+	return 0;
+
+nomem:
+	errno = ENOMEM;
+	return -1;
+}
+
+static int by_estimate(const void *a, const void *b) {
+	const struct top_entry *x = a, *y = b;
+	return (x->estimate < y->estimate) - (x->estimate > y->estimate);
+}
+
+struct top_entry *topk_sorted(struct top_k *t) {
+	qsort(t->heap, t->count, sizeof(*t->heap), by_estimate);
+	return t->heap;
+}
+
+void topk_free(struct top_k *t) {
+	for (size_t i = 0; i < t->k; i++)
+		free(t->heap[i].line);
+	free(t->heap);
+	free(t->index);
+	memset(t, 0, sizeof(*t));
+}
@@ -0,0 +1,108 @@
+#ifndef SKETCH_H
+#define SKETCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * HyperLogLog distinct counter with 2^HLL_BITS one-byte registers, 4 KB.
+ * The standard error of the estimate is 1.04 / sqrt(4096), about 1.6%, so
+ * it is within 3.2% of the true count 95% of the time. Below about 10k
+ * distinct values it falls back to linear counting, which is closer still.
+ */
+#define HLL_BITS 12
+#define HLL_REGISTERS (1 << HLL_BITS)
+
+struct hll {
+	uint8_t registers[HLL_REGISTERS];
+};
+
+void hll_init(struct hll *h);
+
+/**
+ * @param h    [description]
+ * @param hash 64-bit hash of the value, see hash_bytes
+ */
+void hll_add(struct hll *h, uint64_t hash);
+
+double hll_estimate(const struct hll *h);
+
+/**
+ * Count-Min sketch, CM_DEPTH rows of CM_WIDTH 32-bit counters, 8 KB.
+ * Estimates never undercount. With N values added, an estimate is at most
+ * e/CM_WIDTH * N (about 0.53% of N) too high with probability at least
+ * 1 - e^-CM_DEPTH (about 98%). Conservative update, which only raises the
+ * smallest counters, makes the overcount smaller in practice.
+ */
+#define CM_WIDTH 512
+#define CM_DEPTH 4
+
+struct count_min {
+	uint32_t counters[CM_DEPTH][CM_WIDTH];
+	uint64_t total;
+};
+
+void cm_init(struct count_min *cm);
+
+/**
+ * Count one occurrence
+ * @param  cm   [description]
+ * @param  hash [description]
+ * @return      the new estimate for the value
+ */
+uint32_t cm_add(struct count_min *cm, uint64_t hash);
+
+uint32_t cm_estimate(const struct count_min *cm, uint64_t hash);
+
+/**
+ * Approximate top-k: a Count-Min sketch plus a min-heap of the k lines with
+ * the highest estimates seen so far. Memory is the sketch plus k copies of
+ * lines, whatever the input size. A line that is really among the top k
+ * is missed only if the ones below it are overcounted by more than the
+ * margin between them, so the ranking is reliable for lines above about
+ * 0.5% of the input and noise for flat distributions.
+ */
+#define TOPK_MAX (1 << 16) // most lines kept, heap positions are int32_t
+
+struct top_entry {
+	uint64_t hash;
+	uint32_t estimate;
+	char *line;
+	size_t len, size;
+};
+
+struct top_k {
+	struct count_min cm;
+	struct top_entry *heap; // smallest estimate first
+	size_t k, count;
+	int32_t *index; // heap position by hash, -1 for free
+	size_t index_mask;
+};
+
+/**
+ * @param  t [description]
+ * @param  k lines to keep, at most TOPK_MAX
+ * @return   0, or -1 with errno EINVAL if k is too large, ENOMEM if the
+ *           heap cannot be allocated
+ */
+int topk_init(struct top_k *t, size_t k);
+
+/**
+ * @param  t    [description]
+ * @param  line [description]
+ * @param  len  [description]
+ * @return      0, or -1 with errno ENOMEM if the line cannot be copied
+ */
+int topk_add(struct top_k *t, const char *line, size_t len);
+
+/**
+ * Sort the candidates by estimate, highest first. Adding more lines after
+ * this is not allowed.
+ * @param  t [description]
+ * @return   t->count entries
+ */
+struct top_entry *topk_sorted(struct top_k *t);
+
+void topk_free(struct top_k *t);
+
+#endif
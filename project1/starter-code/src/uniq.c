@@ -0,0 +1,891 @@
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "hash.h"
+#include "lines.h"
+#include "lineset.h"
+#include "sketch.h"
+#include "uniq.h"
+
+/**
+ * Heap order for the heavy hitter selection: fewer occurrences is worse, and
+ * between equal counts the line seen later is worse
+ */
+static bool worse(const struct line_entry *entries, size_t a, size_t b) {
+	if (entries[a].count != entries[b].count)
+		return entries[a].count < entries[b].count;
+	return a > b;
+}
+
+static void sift_down(const struct line_entry *entries, size_t *heap, size_t n, size_t i) {
+	while (1) {
+		size_t l = 2 * i + 1, r = l + 1, m = i;
+		if (l < n && worse(entries, heap[l], heap[m]))
+			m = l;
+		if (r < n && worse(entries, heap[r], heap[m]))
+			m = r;
+		if (m == i)
+			return;
+		size_t t = heap[i];
+		heap[i] = heap[m];
+		heap[m] = t;
+		i = m;
+	}
+}
+
+/**
+ * Pick the k most frequent entries with a min-heap of size k, O(n log k)
+ * @param  entries [description]
+ * @param  count   [description]
+ * @param  k       [description]
+ * @return   malloc'd entry indices, most frequent first
+ */
+static size_t *select_top(const struct line_entry *entries, size_t count, size_t k) {
+	size_t *heap = malloc(k * sizeof(*heap));
+	size_t n = 0;
+
+	for (size_t i = 0; i < count; i++) {
+		if (n < k) {
+			// sift up
+			size_t j = n++;
+			heap[j] = i;
+			while (j && worse(entries, heap[j], heap[(j - 1) / 2])) {
+				size_t t = heap[j];
+				heap[j] = heap[(j - 1) / 2];
+				heap[(j - 1) / 2] = t;
+				j = (j - 1) / 2;
+			}
+		} else if (worse(entries, heap[0], i)) {
+			heap[0] = i;
+			sift_down(entries, heap, n, 0);
+		}
+	}
+
+	// popping the worst to the back leaves the best at the front
+	while (n > 1) {
+		size_t t = heap[0];
+		heap[0] = heap[--n];
+		heap[n] = t;
+		sift_down(entries, heap, n, 0);
+	}
+	return heap;
+}
+
+static void print_entry(const struct line_entry *e, const struct uniq_options *opt, FILE *out) {
+	if (opt->count)
+		fprintf(out, "%" PRIu64 " ", e->count);
+	fwrite(e->line, 1, e->len, out);
+	fputc('\n', out);
+}
+
+static void report(const struct line_entry *entries, size_t count,
+				   const struct uniq_options *opt, FILE *out) {
+	if (opt->sort_by_count || opt->top) {
+		size_t k = opt->top && opt->top < count ? opt->top : count;
+		size_t *order = select_top(entries, count, k);
+		for (size_t i = 0; i < k; i++)
+			print_entry(&entries[order[i]], opt, out);
+		free(order);
+	} else {
+		for (size_t i = 0; i < count; i++)
+			print_entry(&entries[i], opt, out);
+	}
+}
+
+/*
+ * Parallel dedupe of a mapped file in two phases. First every thread counts
+ * one newline aligned chunk into its own table and buckets the entries by
+ * the top bits of their hash. Then every thread merges whole shards: the
+ * same line always lands in the same shard, so no two threads ever touch
+ * the same entry and nothing is locked. Since lines are views into the
+ * mapping, the smallest pointer of a line is its first occurrence in the
+ * file, and sorting by it restores the single-threaded order.
+ */
+#define SHARD_BITS 6
+#define SHARDS (1 << SHARD_BITS)
+
+struct chunk {
+	const char *begin, *end;
+	struct line_set set;
+	size_t shard_start[SHARDS + 1]; // bucket bounds in by_shard
+	size_t *by_shard;               // entry indices grouped by shard
+};
+
+struct uniq_worker {
+	int id, jobs;
+	struct chunk *chunks;
+	struct line_set *shards;
+};
+
+static inline unsigned shard_of(uint64_t hash) {
+	// the tables index by the low bits, shards use the high ones
+	return hash >> (64 - SHARD_BITS);
+}
+
+static void *count_chunk(void *arg) {
+	struct uniq_worker *w = arg;
+	struct chunk *c = &w->chunks[w->id];
+	const char *p = c->begin;
+
+	lineset_init(&c->set);
+	c->set.borrow = true;
+	while (p < c->end) {
+		const char *nl = lines_find_newline(p, c->end - p);
+		const char *next = nl ? nl + 1 : c->end;
+		lineset_add(&c->set, p, (nl ? nl : c->end) - p, NULL)->count++;
+		p = next;
+	}
+
+	// counting sort of the entries by shard
+	size_t *start = c->shard_start;
+	memset(start, 0, sizeof(c->shard_start));
+	for (size_t i = 0; i < c->set.count; i++)
+		start[shard_of(c->set.entries[i].hash) + 1]++;
+	for (int s = 0; s < SHARDS; s++)
+		start[s + 1] += start[s];
+
+	size_t fill[SHARDS];
+	memcpy(fill, start, sizeof(fill));
+	c->by_shard = malloc(c->set.count * sizeof(*c->by_shard) + 1);
+	for (size_t i = 0; i < c->set.count; i++)
+		c->by_shard[fill[shard_of(c->set.entries[i].hash)]++] = i;
+	return NULL;
+}
+
+static void *merge_shards(void *arg) {
+	struct uniq_worker *w = arg;
+
+	for (int s = w->id; s < SHARDS; s += w->jobs) {
+		struct line_set *set = &w->shards[s];
+		lineset_init(set);
+		set->borrow = true;
+
+		for (int j = 0; j < w->jobs; j++) {
+			struct chunk *c = &w->chunks[j];
+			for (size_t i = c->shard_start[s]; i < c->shard_start[s + 1]; i++) {
+				const struct line_entry *from = &c->set.entries[c->by_shard[i]];
+				bool added;
+				struct line_entry *e = lineset_add_hashed(set, from->line, from->len,
+														  from->hash, &added);
+				if (from->line < e->line)
+					e->line = from->line;
+				e->count += from->count;
+			}
+		}
+	}
+	return NULL;
+}
+
+static int by_position(const void *a, const void *b) {
+	const char *x = ((const struct line_entry *)a)->line;
+	const char *y = ((const struct line_entry *)b)->line;
+	return (x > y) - (x < y);
+}
+
+static void run_workers(void *(*fn)(void *), struct uniq_worker *workers, int jobs) {
+	pthread_t *threads = malloc(jobs * sizeof(*threads));
+	int started = 1;
+
+	while (threads && started < jobs &&
+	       pthread_create(&threads[started], NULL, fn, &workers[started]) == 0)
+		started++;
+	fn(&workers[0]);
+	// do the shares of the workers no thread could be had for here
+	for (int i = started; i < jobs; i++)
+		fn(&workers[i]);
+	for (int i = 1; i < started; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+}
+
+/**
+ * Dedupe a whole mapping with several threads
+ * @param  data  [description]
+ * @param  size  [description]
+ * @param  jobs  threads, at most UNIQ_MAX_JOBS
+ * @param  count receives the number of distinct lines
+ * @return       malloc'd entries in first-seen order, lines point into
+ *               data, NULL with errno ENOMEM
+ */
+static struct line_entry *uniq_parallel(const char *data, size_t size, int jobs, size_t *count) {
+	struct chunk *chunks = calloc(jobs, sizeof(*chunks));
+	struct uniq_worker *workers = malloc(jobs * sizeof(*workers));
+	struct line_set shards[SHARDS];
+
+	if (!chunks || !workers) {
+		free(chunks);
+		free(workers);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	const char *p = data, *end = data + size;
+	for (int i = 0; i < jobs; i++) {
+		const char *cut = i == jobs - 1 ? end : data + size / jobs * (i + 1);
+		if (cut < p)
+			cut = p;
+		if (cut < end && cut > data && cut[-1] != '\n') {
+			const char *nl = lines_find_newline(cut, end - cut);
+			cut = nl ? nl + 1 : end;
+		}
+		chunks[i].begin = p;
+		chunks[i].end = cut;
+		p = cut;
+		workers[i] = (struct uniq_worker){i, jobs, chunks, shards};
+	}
+
+	run_workers(count_chunk, workers, jobs);
+	run_workers(merge_shards, workers, jobs);
+
+	size_t n = 0;
+	for (int s = 0; s < SHARDS; s++)
+		n += shards[s].count;
+	struct line_entry *entries = malloc(n * sizeof(*entries) + 1);
+	n = 0;
+	for (int s = 0; s < SHARDS; s++) {
+		if (entries)
+			memcpy(entries + n, shards[s].entries, shards[s].count * sizeof(*entries));
+		n += shards[s].count;
+		lineset_free(&shards[s]);
+	}
+	for (int i = 0; i < jobs; i++) {
+		lineset_free(&chunks[i].set);
+		free(chunks[i].by_shard);
+	}
+	free(chunks);
+	free(workers);
+	if (!entries) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	qsort(entries, n, sizeof(*entries), by_position);
+	*count = n;
+	return entries;
+}
+
+/*
+ * External memory dedupe. Lines are counted in one table until it reaches
+ * the budget, then the table is written out to SPILL_PARTS partition files
+ * chosen by six bits of the hash, and counting starts over. A line always
+ * lands in the same partition, so afterwards every partition can be
+ * deduped on its own, merging the counts and keeping the smallest sequence
+ * number as the first occurrence. A partition that is still too big is
+ * split again by the next six bits. Each finished partition is appended
+ * to one result file as a run sorted by the output order, and a k-way
+ * merge of the runs prints the result. However many partitions there
+ * are, at most one file per split level and the result file are open.
+ */
+#define SPILL_BITS 6
+#define SPILL_PARTS (1 << SPILL_BITS)
+#define SPILL_MAX_LEVEL 4 // past this a partition is deduped whatever it costs
+// smaller budgets are raised to this, the partition buffers alone take 4 MB
+#define SPILL_MIN_LIMIT (1024 * 1024)
+
+struct spill_header {
+	uint64_t seq;   // line number of the first occurrence
+	uint64_t count;
+	uint64_t hash;
+	uint64_t len;   // followed by the line itself
+};
+
+struct spill {
+	const struct uniq_options *opt;
+	size_t limit;
+	struct line_set set;
+	uint64_t *seqs; // first occurrence of each entry in set
+	size_t seqs_capacity;
+	FILE *results; // the finished partitions, one sorted run after another
+	off_t *run_ends; // offset where each run ends
+	size_t run_count;
+};
+
+/**
+ * Anonymous temporary file in $TMPDIR, or /tmp
+ * @return [description]
+ */
+static FILE *spill_file(void) {
+	const char *dir = getenv("TMPDIR");
+	if (!dir || !*dir)
+		dir = "/tmp";
+
+	int fd = open(dir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+	if (fd == -1) {
+		// not every file system knows O_TMPFILE
+		char path[PATH_MAX];
+		snprintf(path, sizeof(path), "%s/uniq-XXXXXX", dir);
+		fd = mkostemp(path, O_CLOEXEC);
+		if (fd == -1)
+			return NULL;
+		unlink(path);
+	}
+	FILE *f = fdopen(fd, "w+");
+	if (!f)
+		close(fd);
+	return f;
+}
+
+static inline unsigned spill_part(uint64_t hash, int level) {
+	return (hash >> (64 - SPILL_BITS * (level + 1))) & (SPILL_PARTS - 1);
+}
+
+static int put_record(FILE *f, uint64_t seq, uint64_t count, uint64_t hash,
+					  const char *line, size_t len) {
+	struct spill_header h = {seq, count, hash, len};
+	if (fwrite(&h, sizeof(h), 1, f) != 1 || fwrite(line, 1, len, f) != len)
+		return -1;
+	return 0;
+}
+
+/**
+ * Add occurrences of a line to the table
+ * @param  sp    [description]
+ * @param  line  [description]
+ * @param  len   [description]
+ * @param  hash  [description]
+ * @param  seq   line number of the first of them
+ * @param  count [description]
+ */
+static void spill_count(struct spill *sp, const char *line, size_t len, uint64_t hash,
+						uint64_t seq, uint64_t count) {
+	bool added;
+	struct line_entry *e = lineset_add_hashed(&sp->set, line, len, hash, &added);
+	size_t i = e - sp->set.entries;
+
+	if (added) {
+		if (i == sp->seqs_capacity) {
+			sp->seqs_capacity = sp->seqs_capacity ? sp->seqs_capacity * 2 : 1024;
+			sp->seqs = realloc(sp->seqs, sp->seqs_capacity * sizeof(*sp->seqs));
+		}
+		sp->seqs[i] = seq;
+	} else if (seq < sp->seqs[i]) {
+		sp->seqs[i] = seq;
+	}
+	e->count += count;
+}
+
+static bool spill_full(const struct spill *sp) {
+	return lineset_memory(&sp->set) + sp->seqs_capacity * sizeof(*sp->seqs) > sp->limit;
+}
+
+/**
+ * Write the table out to partition files and empty it
+ * @param  sp    [description]
+ * @param  parts [description]
+ * @param  level which bits of the hash pick the partition
+ * @return       0, or -1 with errno set
+ */
+static int spill_flush(struct spill *sp, FILE **parts, int level) {
+	bool borrow = sp->set.borrow;
+	int r = 0;
+
+	for (size_t i = 0; i < sp->set.count && r == 0; i++) {
+		const struct line_entry *e = &sp->set.entries[i];
+		r = put_record(parts[spill_part(e->hash, level)], sp->seqs[i], e->count,
+					   e->hash, e->line, e->len);
+	}
+	lineset_free(&sp->set);
+	lineset_init(&sp->set);
+	sp->set.borrow = borrow;
+	return r;
+}
+
+static int open_parts(FILE **parts) {
+	for (int i = 0; i < SPILL_PARTS; i++) {
+		parts[i] = spill_file();
+		if (!parts[i]) {
+			while (i--)
+				fclose(parts[i]);
+			return -1;
+		}
+		// a big buffer per file, but all of them together stay small
+		setvbuf(parts[i], NULL, _IOFBF, 64 * 1024);
+	}
+	return 0;
+}
+
+struct spill_item {
+	uint64_t seq, count;
+	const struct line_entry *e;
+};
+
+static bool by_count;
+
+static int spill_order(const void *a, const void *b) {
+	const struct spill_item *x = a, *y = b;
+	if (by_count && x->count != y->count)
+		return x->count < y->count ? 1 : -1;
+	return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+/**
+ * Append the finished table to the result file as a run in output order
+ * @param  sp [description]
+ * @return    0, or -1 with errno set
+ */
+static int spill_result(struct spill *sp) {
+	size_t n = sp->set.count;
+	struct spill_item *items = malloc(n * sizeof(*items) + 1);
+	off_t *run_ends = realloc(sp->run_ends, (sp->run_count + 1) * sizeof(*sp->run_ends));
+	if (run_ends)
+		sp->run_ends = run_ends;
+	if (!items || !run_ends) {
+		free(items);
+		errno = ENOMEM;
+		return -1;
+	}
+	if (!sp->results && !(sp->results = spill_file())) {
+		free(items);
+		return -1;
+	}
+
+	for (size_t i = 0; i < n; i++)
+		items[i] = (struct spill_item){sp->seqs[i], sp->set.entries[i].count, &sp->set.entries[i]};
+	by_count = sp->opt->sort_by_count || sp->opt->top;
+	qsort(items, n, sizeof(*items), spill_order);
+
+	int r = 0;
+	for (size_t i = 0; i < n && r == 0; i++)
+		r = put_record(sp->results, items[i].seq, items[i].count, items[i].e->hash,
+					   items[i].e->line, items[i].e->len);
+	free(items);
+	off_t end = ftello(sp->results);
+	if (r == -1 || end == -1)
+		return -1;
+	sp->run_ends[sp->run_count++] = end;
+	return 0;
+}
+
+/**
+ * Map a spill file for reading
+ * @param  f    [description]
+ * @param  size receives the size
+ * @return      the mapping, MAP_FAILED on errors, NULL if empty
+ */
+static const char *map_spill(FILE *f, size_t *size) {
+	struct stat st;
+	if (fflush(f) != 0 || fstat(fileno(f), &st) == -1)
+		return MAP_FAILED;
+	*size = st.st_size;
+	if (!*size)
+		return NULL;
+	void *map = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+	if (map != MAP_FAILED)
+		madvise(map, *size, MADV_SEQUENTIAL);
+	return map;
+}
+
+/**
+ * Dedupe one partition, splitting it further if it does not fit
+ * @param  sp    [description]
+ * @param  f     partition file, closed here
+ * @param  level how many times the lines were split before
+ * @return       0, or -1 with errno set
+ */
+static int spill_partition(struct spill *sp, FILE *f, int level) {
+	size_t size;
+	const char *data = map_spill(f, &size);
+	FILE *parts[SPILL_PARTS];
+	bool split = false;
+	int r = 0;
+
+	if (data == MAP_FAILED) {
+		fclose(f);
+		return -1;
+	}
+
+	// the lines are read straight out of the mapping
+	sp->set.borrow = true;
+	for (size_t pos = 0; pos < size && r == 0;) {
+		struct spill_header h;
+		memcpy(&h, data + pos, sizeof(h));
+		const char *line = data + pos + sizeof(h);
+		pos += sizeof(h) + h.len;
+
+		if (split) {
+			r = put_record(parts[spill_part(h.hash, level)], h.seq, h.count, h.hash, line, h.len);
+			continue;
+		}
+		spill_count(sp, line, h.len, h.hash, h.seq, h.count);
+		if (spill_full(sp) && level < SPILL_MAX_LEVEL) {
+			r = open_parts(parts);
+			if (r == 0) {
+				split = true;
+				r = spill_flush(sp, parts, level);
+			}
+		}
+	}
+
+	if (!split && r == 0)
+		r = spill_result(sp);
+	lineset_free(&sp->set);
+	lineset_init(&sp->set);
+	if (data)
+		munmap((void *)data, size);
+	fclose(f);
+
+	if (split) {
+		for (int i = 0; i < SPILL_PARTS; i++) {
+			if (r == 0)
+				r = spill_partition(sp, parts[i], level + 1);
+			else
+				fclose(parts[i]);
+		}
+	}
+	return r;
+}
+
+struct merge_cursor {
+	const char *data;
+	size_t size, pos;
+	struct spill_header h;
+	struct spill_item item;
+	struct line_entry e;
+};
+
+static bool cursor_load(struct merge_cursor *c) {
+	if (c->pos >= c->size)
+		return false;
+	memcpy(&c->h, c->data + c->pos, sizeof(c->h));
+	c->e = (struct line_entry){c->data + c->pos + sizeof(c->h), c->h.len, c->h.hash, c->h.count};
+	c->item = (struct spill_item){c->h.seq, c->h.count, &c->e};
+	c->pos += sizeof(c->h) + c->h.len;
+	return true;
+}
+
+static void cursor_sift(struct merge_cursor **heap, size_t n, size_t i) {
+	while (1) {
+		size_t l = 2 * i + 1, r = l + 1, m = i;
+		if (l < n && spill_order(&heap[l]->item, &heap[m]->item) < 0)
+			m = l;
+		if (r < n && spill_order(&heap[r]->item, &heap[m]->item) < 0)
+			m = r;
+		if (m == i)
+			return;
+		struct merge_cursor *t = heap[i];
+		heap[i] = heap[m];
+		heap[m] = t;
+		i = m;
+	}
+}
+
+/**
+ * k-way merge of the sorted runs of the result file
+ * @param  sp  [description]
+ * @param  out [description]
+ * @return     0, or -1 with errno set
+ */
+static int spill_merge(struct spill *sp, FILE *out) {
+	size_t n = sp->run_count, live = 0, size = 0;
+	const char *data = sp->results ? map_spill(sp->results, &size) : NULL;
+	if (data == MAP_FAILED)
+		return -1;
+
+	struct merge_cursor *cursors = calloc(n + 1, sizeof(*cursors));
+	struct merge_cursor **heap = calloc(n + 1, sizeof(*heap));
+	int r = 0;
+	if (!cursors || !heap) {
+		errno = ENOMEM;
+		r = -1;
+	}
+
+	// an empty file, NULL, can only hold empty runs
+	for (size_t i = 0; r == 0 && data && i < n; i++) {
+		size_t start = i ? sp->run_ends[i - 1] : 0;
+		cursors[i].data = data + start;
+		cursors[i].size = sp->run_ends[i] - start;
+		if (cursor_load(&cursors[i]))
+			heap[live++] = &cursors[i];
+	}
+	for (size_t i = live / 2; i-- > 0;)
+		cursor_sift(heap, live, i);
+
+	size_t left = sp->opt->top ? sp->opt->top : SIZE_MAX;
+	while (r == 0 && live && left--) {
+		print_entry(&heap[0]->e, sp->opt, out);
+		if (!cursor_load(heap[0]))
+			heap[0] = heap[--live];
+		cursor_sift(heap, live, 0);
+	}
+
+	if (data)
+		munmap((void *)data, size);
+	free(cursors);
+	free(heap);
+	return r;
+}
+
+/**
+ * Dedupe with at most about limit bytes of memory, but no less than
+ * SPILL_MIN_LIMIT, spilling to disk
+ * @param  src   [description]
+ * @param  opt   [description]
+ * @param  out   [description]
+ * @return       0, or -1 with errno set
+ */
+static int uniq_spill(struct line_source *src, const struct uniq_options *opt, FILE *out) {
+	struct spill sp = {.opt = opt, .limit = opt->memory_limit};
+	FILE *parts[SPILL_PARTS];
+	bool spilled = false;
+	const char *line;
+	size_t len;
+	uint64_t seq = 0;
+	int r = 0;
+
+	if (sp.limit < SPILL_MIN_LIMIT)
+		sp.limit = SPILL_MIN_LIMIT;
+	lineset_init(&sp.set);
+	sp.set.borrow = lines_stable(src);
+	while (r == 0 && (line = lines_next(src, &len))) {
+		spill_count(&sp, line, len, hash_bytes(line, len), seq++, 1);
+		if (spill_full(&sp)) {
+			if (!spilled && (r = open_parts(parts)) == -1)
+				break;
+			spilled = true;
+			r = spill_flush(&sp, parts, 0);
+		}
+	}
+
+	if (r == 0 && !spilled) {
+		// it all fit, the table is already in first-seen order
+		report(sp.set.entries, sp.set.count, opt, out);
+	} else if (r == 0) {
+		r = spill_flush(&sp, parts, 0);
+		for (int i = 0; i < SPILL_PARTS; i++) {
+			if (r == 0)
+				r = spill_partition(&sp, parts[i], 1);
+			else
+				fclose(parts[i]);
+		}
+		if (r == 0)
+			r = spill_merge(&sp, out);
+	} else if (spilled) {
+		for (int i = 0; i < SPILL_PARTS; i++)
+			fclose(parts[i]);
+	}
+
+	int saved = errno;
+	if (sp.results)
+		fclose(sp.results);
+	lineset_free(&sp.set);
+	free(sp.seqs);
+	free(sp.run_ends);
+	errno = saved;
+	return r;
+}
+
+/**
+ * The part of a line adjacent mode compares, a view into the line
+ * @param  opt  [description]
+ * @param  line [description]
+ * @param  len  in: line length, out: key length
+ * @return      start of the key
+ */
+static const char *adjacent_key(const struct uniq_options *opt, const char *line, size_t *len) {
+	const char *p = line, *end = line + *len;
+
+	for (size_t f = 0; f < opt->skip_fields && p < end; f++) {
+		while (p < end && (*p == ' ' || *p == '\t'))
+			p++;
+		while (p < end && *p != ' ' && *p != '\t')
+			p++;
+	}
+	p += (size_t)(end - p) < opt->skip_chars ? (size_t)(end - p) : opt->skip_chars;
+
+	*len = end - p;
+	if (opt->max_chars && *len > opt->max_chars)
+		*len = opt->max_chars;
+	return p;
+}
+
+static void adjacent_group(const struct uniq_options *opt, const char *line, size_t len,
+						   uint64_t count, FILE *out) {
+	if ((opt->repeated && count < 2) || (opt->unique && count > 1))
+		return;
+	if (opt->count)
+		fprintf(out, "%7" PRIu64 " ", count);
+	fwrite(line, 1, len, out);
+	fputc('\n', out);
+}
+
+/**
+ * Collapse runs of lines with equal keys, printing the first of each run.
+ * Only that line is kept, and only copied when the source reuses its buffer.
+ * @param  src [description]
+ * @param  opt [description]
+ * @param  out [description]
+ */
+static void uniq_adjacent(struct line_source *src, const struct uniq_options *opt, FILE *out) {
+	const char *first = NULL, *line;
+	size_t first_len = 0, len;
+	const char *key = NULL;
+	size_t key_len = 0;
+	uint64_t count = 0;
+	char *copy = NULL;
+	size_t copy_size = 0;
+
+	while ((line = lines_next(src, &len))) {
+		size_t line_key_len = len;
+		const char *line_key = adjacent_key(opt, line, &line_key_len);
+
+		if (count && line_key_len == key_len && memcmp(line_key, key, key_len) == 0) {
+			count++;
+			continue;
+		}
+		if (count)
+			adjacent_group(opt, first, first_len, count, out);
+
+		first = line;
+		first_len = len;
+		if (!lines_stable(src)) {
+			if (len > copy_size) {
+				copy_size = len * 2;
+				copy = realloc(copy, copy_size);
+			}
+			memcpy(copy, line, len);
+			first = copy;
+		}
+		key = first + (line_key - line);
+		key_len = line_key_len;
+		count = 1;
+	}
+	if (count)
+		adjacent_group(opt, first, first_len, count, out);
+	free(copy);
+}
+
+/**
+ * Estimate instead of deduping, in a few KB whatever the input
+ * @param  src [description]
+ * @param  opt [description]
+ * @param  out [description]
+ * @return     0, or -1 with errno set if the top lines cannot be kept
+ */
+static int uniq_approx(struct line_source *src, const struct uniq_options *opt, FILE *out) {
+	struct hll hll;
+	struct top_k top;
+	const char *line;
+	size_t len;
+
+	hll_init(&hll);
+	if (topk_init(&top, opt->approx_top) == -1)
+		return -1;
+	while ((line = lines_next(src, &len))) {
+		if (opt->approx_distinct)
+			hll_add(&hll, hash_bytes(line, len));
+		if (opt->approx_top && topk_add(&top, line, len) == -1) {
+			topk_free(&top);
+			errno = ENOMEM;
+			return -1;
+		}
+	}
+
+	if (opt->approx_distinct)
+		fprintf(out, "%.0f\n", hll_estimate(&hll));
+	if (opt->approx_top) {
+		struct top_entry *entries = topk_sorted(&top);
+		for (size_t i = 0; i < top.count; i++) {
+			fprintf(out, "%" PRIu32 " ", entries[i].estimate);
+			fwrite(entries[i].line, 1, entries[i].len, out);
+			fputc('\n', out);
+		}
+	}
+	topk_free(&top);
+	return 0;
+}
+
+int uniq_parse_size(const char *s, size_t *size) {
+	char *end;
+	errno = 0;
+	unsigned long long n = strtoull(s, &end, 10);
+	if (errno || end == s)
+		return -1;
+
+	int shift = 0;
+	switch (toupper((unsigned char)*end)) {
+	case 'K': shift = 10; break;
+	case 'M': shift = 20; break;
+	case 'G': shift = 30; break;
+	case 'T': shift = 40; break;
+	case 0: break;
+	default: return -1;
+	}
+	if (shift && *++end && !(toupper((unsigned char)*end) == 'B' && !end[1]))
+		return -1;
+	if (n > SIZE_MAX >> shift)
+		return -1;
+	*size = n << shift;
+	return 0;
+}
+
+int uniq_file(const char *path, const struct uniq_options *opt, FILE *out) {
+	struct line_source src;
+	struct line_set set;
+	const char *line;
+	size_t len;
+
+	if (!path)
+		lines_open_fd(&src, STDIN_FILENO);
+	else if (lines_open(&src, path) == -1)
+		return -1;
+
+	if (opt->approx_distinct || opt->approx_top) {
+		int r = uniq_approx(&src, opt, out);
+		int saved = errno;
+		lines_close(&src);
+		errno = saved;
+		return r;
+	}
+
+	if (opt->adjacent) {
+		uniq_adjacent(&src, opt, out);
+		lines_close(&src);
+		return 0;
+	}
+
+	if (opt->memory_limit) {
+		int r = uniq_spill(&src, opt, out);
+		int saved = errno;
+		lines_close(&src);
+		errno = saved;
+		return r;
+	}
+
+	// below a few MB the threads cost more than they save
+	int jobs = opt->jobs < UNIQ_MAX_JOBS ? opt->jobs : UNIQ_MAX_JOBS;
+	if (jobs > 1 && lines_stable(&src) && src.size - src.pos >= (size_t)jobs << 20) {
+		size_t count;
+		struct line_entry *entries =
+			uniq_parallel(src.data + src.pos, src.size - src.pos, jobs, &count);
+		if (!entries) {
+			lines_close(&src);
+			errno = ENOMEM;
+			return -1;
+		}
+		report(entries, count, opt, out);
+		free(entries);
+		lines_close(&src);
+		return 0;
+	}
+
+	lineset_init(&set);
+	// views into a mapped file outlive the table, nothing has to be copied
+	set.borrow = lines_stable(&src);
+	while ((line = lines_next(&src, &len)))
+		lineset_add(&set, line, len, NULL)->count++;
+
+	report(set.entries, set.count, opt, out);
+	lineset_free(&set);
+	lines_close(&src);
+	return 0;
+}
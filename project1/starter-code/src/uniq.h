@@ -0,0 +1,51 @@
+#ifndef UNIQ_H
+#define UNIQ_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// uniq -j is clamped to this many threads
+#define UNIQ_MAX_JOBS 64
+
+struct uniq_options {
+	bool count;         // prefix each line with its number of occurrences
+	bool sort_by_count; // most frequent lines first instead of first-seen order
+	size_t top;         // only the top most frequent lines, 0 for all
+	int jobs;           // threads for a mapped file, 0 or 1 for none
+	size_t memory_limit; // spill to temporary files past this, at least 1M, 0 for none
+
+	// adjacent mode, for sorted input: only neighbours are compared, O(1) memory
+	bool adjacent;
+	bool repeated;      // -d, only print lines that have duplicates
+	bool unique;        // -u, only print lines that have none
+	size_t skip_fields; // -f, blank separated fields not compared
+	size_t skip_chars;  // -s, characters not compared after those
+	size_t max_chars;   // -w, characters compared at most, 0 for all
+
+	// fixed-memory estimates, see sketch.h for their error bounds
+	bool approx_distinct; // print about how many distinct lines there are
+	size_t approx_top;    // print about the most frequent lines, 0 for none
+};
+
+/**
+ * Print the distinct lines of a file in the order they first appear. The
+ * whole file is read once, counts are kept in the same table. In adjacent
+ * mode only runs of equal lines are collapsed, like coreutils uniq.
+ * @param  path NULL for standard input
+ * @param  opt  [description]
+ * @param  out  [description]
+ * @return      0, or -1 with errno set if the file could not be read or
+ *              spilling to disk failed
+ */
+int uniq_file(const char *path, const struct uniq_options *opt, FILE *out);
+
+/**
+ * Parse a size such as 512K, 64M or 8G
+ * @param  s    [description]
+ * @param  size [description]
+ * @return      0, or -1 if s is not a size
+ */
+int uniq_parse_size(const char *s, size_t *size);
+
+#endif